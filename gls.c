@@ -9,8 +9,8 @@
 //  gls.c
 //
 //  compile with:
-//      Linux:  gcc -Wall -lssl -lcrypto gls.c -o gls
-//      OS X:   gcc -Wall gls.c -o gls
+//      Linux:  gcc -Wall gls.c libgls.c -o gls -lssl -lcrypto -lpthread
+//      OS X:   gcc -Wall gls.c libgls.c -o gls
 //
 //
 // Description:
@@ -24,12 +24,26 @@
 // and the absolute path of that location. If an error is encountered at any point
 // during operation the offending entry is skipped and an error message will be
 // printed indicating the cause of failure for that entry. When no directory path
-// is specified the current working directory is assumed.
+// is specified the current working directory is assumed. When several directories
+// are specified they are scanned concurrently and listed one after another in the
+// order given, each preceded by its path.
 //
+// The traversal, sizing and hashing are done by libgls (see libgls.h), gls only
+// formats the entries it visits.
 //
-// usage: 'gls [-ah] [directory_name]'
+//
+// usage: 'gls [-adh] [--cache=FILE] [--sort=KEY] [--check MANIFEST [--fail-fast]] [--jobs=N] [--roots-from=FILE] [directory_name ...]'
 //     a : show hidden files and directories
+//     d : display a merkle digest for each directory computed from its entries
 //     h : display file sizes in human readable format (i.e. KB, MB, GB)
+//     --cache=FILE : reuse md5 checksums of unchanged files stored in FILE by a previous run
+//     --sort=KEY   : order entries by KEY, one of name-bytes (default), size (largest first),
+//                    mtime (newest first) or none (order entries are read from the directory)
+//     --check MANIFEST : verify the files in the directory against an md5sum style manifest instead
+//                        of listing them, printing files which are FAILED, MISSING or EXTRA
+//     --fail-fast      : stop checking at the first failure
+//     --jobs=N         : number of threads used to scan directories and hash files (default: number of CPUs)
+//     --roots-from=FILE : also list the directories named in FILE, one per line ('-' for standard input)
 //
 //
 // All work in this assignment is my own other than the cited out of class resources.
@@ -55,49 +69,33 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <pthread.h>
 
+#include "libgls.h"
 
-#define VERSION "1.0"
-
-
-#ifdef __APPLE__
-
-    // Used to test the code on my personal machine
-
-    // Starting with OS X Yosemite Apple removed the OpenSSL developement headers and
-    // switched to using their own CommonCrypto library to replace OpenSSL. Luckily
-    // CommonCrypto has an almost identical interface to OpenSSL which allows this
-    // simple hack below to emulate some of the OpenSSL MD5 interface using the
-    // CommonCrypto MD5 hash functions
-
-    #include <CommonCrypto/CommonCrypto.h>
-
-    #define MD5_DIGEST_LENGTH CC_MD5_DIGEST_LENGTH
 
-    typedef CC_MD5_CTX MD5_CTX;
-
-    // Function pointers to map OpenSSL MD5 hash functions to CommonCrypto
-    // MD5 hash functions
-    static int(* const MD5_Init)(MD5_CTX*) = CC_MD5_Init;
-    static int(* const MD5_Update)(MD5_CTX*, const void*, unsigned int) = CC_MD5_Update;
-    static int(* const MD5_Final)(unsigned char*, MD5_CTX*) = CC_MD5_Final;
-
-#elif defined __linux__
-    #include <openssl/md5.h>
-#elif
-    #error Missing crypto library for MD5 hash (OpenSSL or CommonCrypto required)
-#endif
+#define VERSION "1.0"
 
 
 
 /* -------- GLOBAL VARIABLES -------- */
 
-// Stores function to use to filter directory entries when using scandir()
-static int(* filter_function)(const struct dirent*);
+// Stores the options for the scan (i.e. hidden entries, digests, sort order)
+static gls_options_t scan_options;
 
 // Stores function to convert number of bytes into string
 static char*(* byte_formatter)(long long);
 
+// Flag indicating whether checking against a manifest stops at the first failure ('--fail-fast')
+static int check_fail_fast;
+
+// Number of worker threads used to hash files or scan directories ('--jobs=N')
+static int num_jobs;
+
 
 /* -------- END GLOBAL VARIABLES -------- */
 
@@ -149,38 +147,6 @@ static const char* file_type_str(unsigned char f_type) {
 
 
 
-/* -------- FILE/DIRECTORY FILTERING FUNCTIONS -------- */
-
-
-// Filter function for scandir(), filters out hidden files and directories
-//
-// parameters:
-//      entry - the directory entry to be tested
-//
-// returns: int
-//      0 if directory entry is hidden, nonzero otherwise
-//
-static int filter_hidden(const struct dirent* entry) {
-    return (entry->d_name[0] == '.') ? 0 : 1;
-}
-
-// Filter function for scandir(), filters out only parent and current directory ('.' and '..')
-//
-// parameters:
-//      entry - the directory entry to be tested
-//
-// returns: int
-//      0 if directory entry is parent ('..') or current ('.'), nonzero otherwise
-//
-static int filter_show_hidden(const struct dirent* entry) {
-    return ( strncmp(entry->d_name, ".", 2) == 0 || strncmp(entry->d_name, "..", 3) == 0 ) ? 0 : 1;
-}
-
-/* -------- END FILE/DIRECTORY FILTERING FUNCTIONS -------- */
-
-
-
-
 
 
 /* -------- BYTE SIZE FORMATTING FUNCTIONS -------- */
@@ -254,422 +220,1225 @@ static char* byte_format_human(long long num_bytes) {
 
 
 
+/* -------- OUTPUT FUNCTIONS -------- */
+
 
+// Context of the output visitor callbacks
+typedef struct {
+    FILE* out;                  // Stream to print to
+    int   digest_incomplete;    // Set once a digest of a tree with unreadable entries was printed
+} print_context_t;
 
 
-// Recursive helper function for computer_dir_size(), see below
+// Prints the indentation in front of an entry
 //
 // parameters:
-//      dir_path   - the path of the directory to be scanned
-//      pdir_sizes - pointer to array of directory sizes
-//      dir_index  - pointer to current index into 'pdir_sizes' array
-//      array_size - pointer to number of elements 'pdir_sizes' can currently hold (for resizing array)
-//
-//      dont_store - flag indicating whether or not to store the directory size in the 'pdir_sizes'
-//                   array, used by recursive calls to skip storing hidden directory sizes when the
-//                   filter function is set to filter hidden entries. 0 indicates this flag is false
-//                   1 indicates the flag is true
+//      out   - stream to print to
+//      depth - depth of the entry (as specified in gls_entry_t)
+//      fill  - character to indent with, '-' for directories and ' ' for other entries
 //
 // returns: void
 //
-static void compute_dir_size_r(const char* dir_path, off_t** pdir_sizes, int* dir_index, int* array_size, int dont_store) {
-    int cur_index = *dir_index;
+static void print_indentation(FILE* out, int depth, char fill) {
+    if(depth >= 2) {
+        char indentation_str[(depth-1)*3];
+        memset(indentation_str, fill, (depth-1)*3);
+        fprintf(out, "%.*s", (depth-1)*3, indentation_str);
+    }
+}
+
+
+// Visitor callback for gls_scan(), prints the information line of a directory. A digest
+// which does not describe the whole subtree is followed by 'incomplete'
+//
+// parameters:
+//      entry   - the directory
+//      context - the print context
+//
+// returns: int
+//      always 0 to continue the scan
+//
+static int print_enter_directory(const gls_entry_t* entry, void* context) {
+    print_context_t* print_context = context;
+    FILE*            out           = print_context->out;
     
-    //  The following if block doubles the memory capacity for the pdir_sizes array when
-    //  the array is full.
-    //
-    //  The resizing is done in this way to keep the cost of insertion to O(1) since the
-    //  size is not known ahead of time. By doubling the size, each resizing operation,
-    //  the number of resizes required tends to 0 as more and more elements are inserted
-    //  since the size of the array grows exponentially while the number of elements
-    //  being inserted grows linearly (i.e. amortization).
-    //
-    if(*dir_index >= *array_size) {
-        *array_size *= 2;
-        *pdir_sizes = realloc(*pdir_sizes, sizeof(off_t) * (*array_size));
+    print_indentation(out, entry->depth, '-');
+    
+    // Check if directory was succesfully scanned otherwise print error message
+    if(entry->error == GLS_ERROR_SCAN_DIRECTORY) {
+        fprintf(out, "| %s (directory - error parsing directory: %s)\n", entry->name, strerror(entry->error_number));
+        return 0;
     }
     
-    // Initialize directory size
-    (*pdir_sizes)[cur_index] = 0;
+    // Print directory information (for directories other than the root working directory,
+    // unless digests are shown in which case the root digest is printed on the first line)
+    if(entry->has_digest) {
+        char* size_str = byte_formatter((long long)entry->size);
+        char  digest_str[GLS_DIGEST_LENGTH*2 + 1];
+        gls_md5_to_strn(entry->digest, digest_str, sizeof(digest_str));
+        
+        fprintf(out, "%s%s (directory - %s - %s%s)\n", (entry->depth >= 1) ? "| " : "", entry->name, size_str, digest_str,
+                entry->digest_incomplete ? " - incomplete" : "");
+        free(size_str);
+        
+        if(entry->digest_incomplete) {
+            print_context->digest_incomplete = 1;
+        }
+    } else if(entry->depth >= 1) {
+        char* size_str = byte_formatter((long long)entry->size);
+        fprintf(out, "| %s (directory - %s)\n", entry->name, size_str);
+        free(size_str);
+    }
     
-    struct dirent** entries;
-    int num_entries = scandir(dir_path, &entries, filter_show_hidden, alphasort);
+    if(entry->num_entries == 0) {      // Directory was successfully scanned but had no entries
+        print_indentation(out, entry->depth + 1, ' ');
+        fprintf(out, "*** empty directory ***\n");
+    }
     
-    // Check if directory was successfully scanned otherwise exit function
-    if(num_entries < 0) {
-        return;
-    } else if(num_entries == 0) {
-        // Directory was successfully scanned but had no entries
-        free(entries);
-        return;
+    return 0;
+}
+
+
+// Visitor callback for gls_scan(), prints an error after the entries of a directory
+// which could not be read to the end (entries visited as they are read with
+// '--sort=none'), the other errors were already printed with the directory
+//
+// parameters:
+//      entry   - the directory
+//      context - the print context
+//
+// returns: int
+//      always 0 to continue the scan
+//
+static int print_leave_directory(const gls_entry_t* entry, void* context) {
+    FILE* out = ((print_context_t*)context)->out;
+    
+    if(entry->error == GLS_ERROR_SCAN_DIRECTORY && entry->num_entries > 0) {
+        print_indentation(out, entry->depth + 1, ' ');
+        fprintf(out, "*** error reading directory: %s ***\n", strerror(entry->error_number));
     }
     
-    // Save current directory, this is needed to restore the working directory
-    // later, this doesn't need error checking since scandir would not return
-    // successful and thus the function would exit before executing this statement
-    DIR* dir_save = opendir(".");
+    return 0;
+}
+
+
+// Visitor callback for gls_scan(), prints the information line of an entry which
+// is not a directory
+//
+// parameters:
+//      entry   - the entry
+//      context - the print context
+//
+// returns: int
+//      always 0 to continue the scan
+//
+static int print_visit_entry(const gls_entry_t* entry, void* context) {
+    FILE* out = ((print_context_t*)context)->out;
     
-    // Switch working directory to given directory
-    chdir(dir_path);
+    print_indentation(out, entry->depth, ' ');
     
-    for(int i=0; i < num_entries; free(entries[i]), i++) {
-        struct dirent* current_dirent = entries[i];
+    if(entry->type == DT_REG) {                     // Regular files
+        
+        // If stat failed then print the name, type of file and an error message
+        if(entry->error == GLS_ERROR_STAT_FILE) {
+            fprintf(out, "| %s (%s - error parsing file: %s)\n", entry->name, file_type_str(entry->type), strerror(entry->error_number));
+            return 0;
+        }
+        
+        // Format byte size
+        char* size_str = byte_formatter((long long)entry->size);
         
-        // Recursively calculate size of subdirectory
-        if(current_dirent->d_type == DT_DIR) {
+        if(entry->has_digest) {
+            char md5_str[GLS_DIGEST_LENGTH*2 + 1];
+            gls_md5_to_strn(entry->digest, md5_str, sizeof(md5_str));
             
-            // Parse subdirectory recursively
-            if( (current_dirent->d_name[0] == '.' && filter_function == filter_hidden) || dont_store == 1) {
-                
-                // If the subdirectory in question is a hidden subdirectory and the filter function specifies
-                // that hidden entries should be ignored then we do not want to store the corresponding size
-                // in the 'pdir_sizes' array as it is not needed and will mess up the indexing used by
-                // parse_directory(). To recursively compute the directory size without storing the sizes in
-                // the 'pdir_sizes' array, the 'dont_store' flag is set so resize or index advance operations
-                // are not attempted, the subdirectory size will be stored on the stack in 'subdir_size'
-                
-                int    local_index  = 0;
-                off_t* subdir_size  = alloca(sizeof(off_t));    // Alloca is used here since [1] gives a type warning
+            // Print file information and md5 checksum
+            fprintf(out, "| %s (%s - %s - %s)\n", entry->name, file_type_str(entry->type), size_str, md5_str);
+            
+        } else {
+            
+            // An error occured while opening/reading the file, in this case the rest
+            // of the information on the file will be printed but the md5 checksum
+            // will be replaced with an error message
+            fprintf(out, "| %s (%s - %s - error computing md5: %s)\n", entry->name, file_type_str(entry->type), size_str, (entry->error_number == 0) ? "hash error" : strerror(entry->error_number));
+            
+        }
+        
+        free(size_str);
+    } else if(entry->type == DT_LNK) {              // Symbolic links
+        
+        // If an error occured while trying to lstat, read or resolve the symlink, an error
+        // message will be printed to the user
+        switch(entry->error) {
+            case GLS_ERROR_STAT_SYMLINK:
+                fprintf(out, "| %s (%s - error parsing symlink: %s)\n", entry->name, file_type_str(entry->type), strerror(entry->error_number));
+                break;
                 
-                compute_dir_size_r(current_dirent->d_name, &subdir_size, &local_index, array_size, 1);
+            case GLS_ERROR_READ_SYMLINK:
+                fprintf(out, "| %s (%s - error reading symlink: %s)\n", entry->name, file_type_str(entry->type), strerror(entry->error_number));
+                break;
                 
-                // Add subdirectory size to current directory size
-                (*pdir_sizes)[cur_index] += *subdir_size;
-            } else {
-                int r_index = ++(*dir_index);
-                compute_dir_size_r(current_dirent->d_name, pdir_sizes, dir_index, array_size, 0);
+            case GLS_ERROR_RESOLVE_SYMLINK:
+                fprintf(out, "| %s (%s - error resolving symlink: %s)\n", entry->name, file_type_str(entry->type), strerror(entry->error_number));
+                break;
                 
-                // Add subdirectory size to current directory size
-                (*pdir_sizes)[cur_index] += (*pdir_sizes)[r_index];
-            }
-            
-        } else if(current_dirent->d_type == DT_REG) {
-            // Get file size
-            struct stat entry_info;
-            if(stat(current_dirent->d_name, &entry_info) < 0) {
-                // If stat fails skip file
-                continue;
-            }
-            
-            // Add file size to current directory size
-            (*pdir_sizes)[cur_index] += entry_info.st_size;
+            default:
+                fprintf(out, "| %s (%s - points to '%s', absolute path : '%s')\n", entry->name, file_type_str(entry->type), entry->link_contents, entry->link_path);
         }
+    } else {                                        // Other (i.e. character devices and block devices)
+        fprintf(out, "| %s (%s)\n", entry->name, file_type_str(entry->type));
     }
     
-    // Free memory for dirent array
-    free(entries);
-    
-    // Switch back to working directory before function call
-    fchdir(dirfd(dir_save));
-    closedir(dir_save);
+    return 0;
 }
 
+/* -------- END OUTPUT FUNCTIONS -------- */
+
 
-// Recursively traverses the file tree at root 'dir_path' and computes directory sizes
-// to be returned in an array
+
+
+// Recursively traverses the file tree at root 'dir_path' and prints information on
+// the child directory entries including name, size, type and md5 checksum
 //
 // parameters:
 //      dir_path  - the path of the directory to be scanned
+//      out       - stream to print to
 //
-// returns: off_t*
-//      An array with directory sizes in bytes. Array order is alphabetical and is same as
-//      parse_directory() scan order. First index (index 0) corresponds to the size of the
-//      directory pointed to by 'dir_path'. Array must be freed using free()
+// returns:     int
+//      nonzero if a digest printed is incomplete since some entries could not be read, 0 otherwise
 //
-static off_t* compute_dir_size(const char* dir_path) {
-    // Initialize array to arbitrary size and zero elements
-    off_t* dir_sizes = calloc(sizeof(off_t), 10);
+static int parse_directory(const char* dir_path, FILE* out) {
+    print_context_t print_context = { out, 0 };
+    gls_visitor_t   visitor       = { print_enter_directory, print_leave_directory, print_visit_entry, &print_context };
     
-    int index = 0;
-    int array_size = 10;
-    compute_dir_size_r(dir_path, &dir_sizes, &index, &array_size, 0);
+    gls_scan(dir_path, &scan_options, &visitor);
     
-    return dir_sizes;
+    return print_context.digest_incomplete;
 }
 
 
 
-// Computes md5 checksum of file contents of file at 'path' and places the
-// the corresponding checksum as a string of hexadecimal characters into
-// the buffer pointed to by 'md5_str' including the null terminator. If
-// the buffer size 'n' is less than MD5_DIGEST_LENGTH*2 + 1 = 33 bytes
-// then the string is truncated to n-1 characters and null terminated
+
+
+/* -------- MULTIPLE ROOT FUNCTIONS -------- */
+
+// When more than one directory is given (as arguments or with '--roots-from=FILE') the
+// roots are scanned at the same time by workers which take roots one at a time in the
+// order they were given, so no root waits on another. The '--jobs' threads are shared
+// by all roots: threads beyond one per root hash files ahead of the scans through a
+// hashing pool (see gls_pool_create()), and a worker left without a root to take joins
+// that pool, so the last roots still being scanned use every thread. A single root is
+// scanned by the main thread with the other threads hashing for it the same way.
+// The root at the head of the order (every root before it printed) is listed straight
+// to standard output, the others are listed into their own temporary file and the main
+// thread prints the listings in the order the roots were given once they are complete,
+// so the output of a root is never interleaved with that of another. Workers only take
+// roots a few ahead of the head (see ROOTS_AHEAD_PER_WORKER), so a slow root does not
+// leave a temporary file open for every root after it.
+
+
+// Number of roots per worker which may be taken past the first root not yet printed
+#define ROOTS_AHEAD_PER_WORKER 2
+
+
+// Directory given to be listed
+typedef struct {
+    char*       path;
+    FILE*       output;         // Temporary file holding the listing, NULL if it could not be listed
+    const char* error_format;   // Message printed instead of the listing if it could not be listed
+    int         error_number;
+    int         digest_incomplete;  // Nonzero if a digest printed for the root is incomplete
+    int         streamed;       // Nonzero if listed straight to standard output
+    int         done;           // Nonzero once the root was scanned
+} root_t;
+
+
+static root_t*         roots;
+static int             roots_count;
+static int             roots_capacity;
+static int             roots_next;          // Index of the next root to be scanned by a worker
+static int             roots_printed;       // Number of roots at the head of the order already printed
+static int             roots_ahead_max;     // Number of roots which may be taken from 'roots_printed' on
+static int             roots_listed;        // Number of listings printed, for the blank lines between them
+static pthread_mutex_t roots_mutex     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  roots_done_cond = PTHREAD_COND_INITIALIZER;     // Broadcast when a root is done or printed
+
+
+// Appends a directory to the list of roots
 //
 // parameters:
-//      path     - the path of the file used to calculate the md5 checksum
-//      blk_size - blocksize for efficient filesystem I/O, can be obtained from stat struct field 'st_blksize'
-//      md5_str  - pointer to a buffer to hold the md5 checksum hexadecimal string
-//      n        - the size of the buffer in bytes
+//      path - path of the directory
 //
-// returns: int
-//      0 if the md5 checksum was computed successfully, otherwise -1 will be returned.
-//      If the error was due to file IO errno will be set appropriately, otherwise the
-//      error was caused by the MD5 hashing. Thus errno should be cleared before calling
-//      this function.
+// returns: void
 //
-static int fcompute_md5_strn(const char* path, blksize_t blk_size, char* md5_str, unsigned int n) {
-    // Open file for binary read
-    FILE* fp = fopen(path, "rb");
-    
-    // Check if file opened successfully, if not return -1 to indicate an error
-    if(fp == NULL) {
-        return -1;
+static void root_add(const char* path) {
+    if(roots_count == roots_capacity) {
+        roots_capacity = (roots_capacity == 0) ? 8 : roots_capacity * 2;
+        roots          = realloc(roots, sizeof(root_t) * roots_capacity);
     }
     
-    // Setup md5 context
-    MD5_CTX md5_ctx;
-    if(MD5_Init(&md5_ctx) == 0) {   // Check for initialization error
-        
-        // If an error occured close the file and return -1 to indicate error
-        fclose(fp);
+    root_t* root = &roots[roots_count++];
+    memset(root, 0, sizeof(root_t));
+    root->path = strdup(path);
+}
+
+
+// Appends the directories listed in the file at 'path' to the list of roots, one path
+// per line with empty lines ignored. A path of '-' reads the list from standard input
+//
+// parameters:
+//      path - path of the file listing the roots
+//
+// returns: int
+//      0 if the file was read successfully, -1 otherwise with errno set appropriately
+//
+static int roots_load(const char* path) {
+    FILE* fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+    if(fp == NULL) {
         return -1;
     }
     
-    // Read bytes from the file until either EOF is reached or an error occurs
-    unsigned char buffer[blk_size];
-    unsigned int bytes_read;
+    char*   line      = NULL;
+    size_t  line_size = 0;
+    ssize_t line_length;
     
-    do {
-        bytes_read = (unsigned int)fread(buffer, 1, blk_size, fp);
-        
-        // If a read error occured close the file and return -1 to indicate error
-        if(ferror(fp) != 0) {
-            fclose(fp);
-            return -1;
+    while((line_length = getline(&line, &line_size, fp)) >= 0) {
+        if(line_length > 0 && line[line_length - 1] == '\n') {
+            line[--line_length] = '\0';
         }
         
-        MD5_Update(&md5_ctx, buffer, bytes_read);
-    } while(feof(fp) == 0);
-    
-    fclose(fp);
-    
-    // Put md5 hash into 'md5_bytes'
-    unsigned char md5_bytes[MD5_DIGEST_LENGTH];
-    if(MD5_Final(md5_bytes, &md5_ctx) == 0) {
-        // If an error occured return -1 to indicate error
-        return -1;
+        if(line_length > 0) {
+            root_add(line);
+        }
     }
     
-    // Convert md5 hash into hex string and place into 'md5_str'
-    static const char* hex_table = "0123456789abcdef";
-    
-    int i;
-    for(i=0; i < MD5_DIGEST_LENGTH && i*2 < n-2; i++) {
-        // 'hex_table' is used to convert nibbles to hex chars
-        // string is written in big-endian so the MSB is written
-        // first and he LSB last, as an example the binary string
-        // 1001 1010 0001 1111 becomes 9A1F
-        (*md5_str++) = hex_table[(md5_bytes[i]>>4) & 0xF];
-        (*md5_str++) = hex_table[ md5_bytes[i]     & 0xF];
-    }
+    free(line);
     
-    // If the string was truncated check to see if one more hex digit
-    // could fit
-    if(i < MD5_DIGEST_LENGTH && i*2 < n-1) {
-        (*md5_str++) = hex_table[(md5_bytes[i]>>4) & 0xF];
+    if(fp != stdin) {
+        fclose(fp);
     }
     
-    *md5_str = '\0';    // Append null terminator
-    
-    return 0;   // return success
+    return 0;
 }
 
 
+// Prints the line preceding the listing of a root when several roots are listed, only
+// called by the thread printing to standard output at the time
+//
+// parameters:
+//      root - the root about to be listed
+//
+// returns: void
+//
+static void root_print_header(const root_t* root) {
+    printf("%s%s:\n", (roots_listed > 0) ? "\n" : "", root->path);
+    roots_listed++;
+}
+
 
-// Recursive helper function for parse_directory(), see below
+// Checks that a root is an accessible directory and lists it into 'out', or records
+// why it could not be listed. A root streamed to standard output is preceded by its path
 //
 // parameters:
-//      dir_path  - the path of the directory to be scanned
-//      dir_sizes - an array of directory sizes
-//      dir_index - pointer to current index into 'pdir_sizes' array
-//      cur_depth - current number of subdirectories followed (for output indentation)
+//      root - the root to be listed
+//      out  - stream to print to, NULL for a new temporary file stored in the root
 //
 // returns: void
 //
-static void parse_directory_r(const char* dir_path, off_t* dir_sizes, int* dir_index, int cur_depth) {
-    struct dirent** entries;
-    int num_entries = scandir(dir_path, &entries, filter_function, alphasort);
-    
-    // Check if directory was succesfully scanned otherwise print error message
-    // and return
-    if(num_entries < 0) {
-        printf("| %s (directory - error parsing directory: %s)\n", dir_path, strerror(errno));
+static void root_scan(root_t* root, FILE* out) {
+    DIR* dir = opendir(root->path);
+    if(dir == NULL) {
+        root->error_format = "gls: Error accessing '%s': %s\n";
+        root->error_number = errno;
         return;
     }
+    closedir(dir);
     
-    // Print directory information (for directories other than the root working directory)
-    if(cur_depth >= 1) {
-        char* size_str = byte_formatter((long long)dir_sizes[*dir_index]);
-        printf("| %s (directory - %s)\n", dir_path, size_str);
-        free(size_str);
+    if(out == NULL) {
+        root->output = out = tmpfile();
+        
+        if(out == NULL) {
+            root->error_format = "gls: Error buffering listing of '%s': %s\n";
+            root->error_number = errno;
+            return;
+        }
+    }
+    
+    if(root->streamed) {
+        root_print_header(root);
     }
     
-    if(num_entries == 0) {      // Directory was successfully scanned but had no entries
+    root->digest_incomplete = parse_directory(root->path, out);
+}
+
+
+// Reports a root whose listing shows incomplete digests, which cannot be compared with
+// the digests of other trees
+//
+// parameters:
+//      root - the listed root
+//
+// returns: void
+//
+static void root_report_incomplete(const root_t* root) {
+    fprintf(stderr, "gls: Digests of '%s' are incomplete, some entries could not be read\n", root->path);
+}
+
+
+// Worker thread scanning roots until every root was taken
+//
+// parameters:
+//      arg - unused
+//
+// returns: void*
+//      always NULL
+//
+static void* root_worker(void* arg) {
+    for(;;) {
+        pthread_mutex_lock(&roots_mutex);
         
-        // Print indentation
-        if(cur_depth >= 1) {
-            char indentation_str[cur_depth*3];
-            memset(indentation_str, ' ', cur_depth*3);
-            printf("%.*s", cur_depth*3, indentation_str);
+        // Wait for the roots before to be printed rather than buffer too many listings
+        while(roots_next < roots_count && roots_next >= roots_printed + roots_ahead_max) {
+            pthread_cond_wait(&roots_done_cond, &roots_mutex);
         }
         
-        printf("*** empty directory ***\n");
+        int index = roots_next++;
         
-        free(entries);
+        // Nothing is printed to standard output until the root at the head is done
+        if(index < roots_count) {
+            roots[index].streamed = (index == roots_printed);
+        }
         
-        return;
+        pthread_mutex_unlock(&roots_mutex);
+        
+        // Help hash the files of the roots still being scanned until all are done
+        if(index >= roots_count) {
+            if(scan_options.pool != NULL) {
+                gls_pool_work(scan_options.pool);
+            }
+            
+            return NULL;
+        }
+        
+        root_scan(&roots[index], roots[index].streamed ? stdout : NULL);
+        
+        pthread_mutex_lock(&roots_mutex);
+        roots[index].done = 1;
+        pthread_cond_broadcast(&roots_done_cond);
+        pthread_mutex_unlock(&roots_mutex);
+    }
+}
+
+
+// Lists every root, a single root is listed directly to standard output while several
+// roots are scanned concurrently and printed in order, each preceded by its path
+//
+// parameters: none
+//
+// returns: int
+//      0 if every root was listed, 3 if any root could not be listed or has incomplete digests
+//
+static int list_roots(void) {
+    int status = 0;
+    
+    if(roots_count == 1) {
+        scan_options.pool = (num_jobs > 1) ? gls_pool_create(num_jobs - 1) : NULL;
+        
+        root_scan(&roots[0], stdout);
+        
+        gls_pool_free(scan_options.pool);
+        scan_options.pool = NULL;
+        
+        if(roots[0].error_format != NULL) {
+            fprintf(stderr, roots[0].error_format, roots[0].path, strerror(roots[0].error_number));
+            status = 3;
+        } else if(roots[0].digest_incomplete) {
+            fflush(stdout);
+            root_report_incomplete(&roots[0]);
+            status = 3;
+        }
+        
+        free(roots[0].path);
+        free(roots);
+        
+        return status;
     }
     
-    // Save current directory, this is needed to restore the working directory
-    // later, this doesn't need error checking since scandir would not return
-    // successful and thus the function would exit before executing this statement
-    DIR* dir_save = opendir(".");
+    // More workers than roots would have nothing to do
+    int num_workers = (num_jobs < roots_count) ? num_jobs : roots_count;
+    
+    roots_ahead_max = num_workers * ROOTS_AHEAD_PER_WORKER;
     
-    // Switch working directory to given directory
-    chdir(dir_path);
+    // The remaining threads only hash, workers join them once no root is left to take
+    scan_options.pool = gls_pool_create(num_jobs - num_workers);
+    
+    pthread_t workers[num_workers];
+    for(int i=0; i < num_workers; i++) {
+        pthread_create(&workers[i], NULL, root_worker, NULL);
+    }
     
-    for(int i=0; i < num_entries; free(entries[i]), i++) {
-        struct dirent* current_dirent = entries[i];
+    for(int i=0; i < roots_count; i++) {
+        root_t* root = &roots[i];
         
-        // Handle indentation printing
-        if(cur_depth >= 1) {
-            char indentation_str[cur_depth*3];
-            memset(indentation_str, (current_dirent->d_type == DT_DIR) ? '-' : ' ', cur_depth*3);
-            printf("%.*s", cur_depth*3, indentation_str);
+        pthread_mutex_lock(&roots_mutex);
+        while(!root->done) {
+            pthread_cond_wait(&roots_done_cond, &roots_mutex);
         }
+        pthread_mutex_unlock(&roots_mutex);
         
-        if(current_dirent->d_type == DT_DIR) {          // Subdirectories
-            
-            // Parse subdirectory recursively
-            (*dir_index)++;
-            parse_directory_r(current_dirent->d_name, dir_sizes, dir_index, cur_depth+1);
-        } else if(current_dirent->d_type == DT_REG) {   // Regular files
-            
-            // Get file size
-            struct stat entry_info;
-            if(stat(current_dirent->d_name, &entry_info) < 0) {
-                // If stat failed then print the name, type of file and an error message
-                printf("| %s (%s - error parsing file: %s)\n", current_dirent->d_name, file_type_str(current_dirent->d_type), strerror(errno));
-                continue;
-            }
-            
-            // Format byte size
-            char* size_str = byte_formatter((long long)entry_info.st_size);
-            
-            // Compute MD5 checksum of file
-            char md5_str[MD5_DIGEST_LENGTH*2 + 1];
-            errno = 0;
-            
-            if(fcompute_md5_strn(current_dirent->d_name, entry_info.st_blksize, md5_str, MD5_DIGEST_LENGTH*2 + 1) == 0) {
-                
-                // Print file information and md5 checksum
-                printf("| %s (%s - %s - %s)\n", current_dirent->d_name, file_type_str(current_dirent->d_type), size_str, md5_str);
+        if(root->error_format != NULL) {
+            // Keep the message in order with the listings before it
+            fflush(stdout);
+            fprintf(stderr, root->error_format, root->path, strerror(root->error_number));
+            status = 3;
+        } else {
+            // A streamed root was already printed by its worker
+            if(!root->streamed) {
+                root_print_header(root);
                 
-            } else {
+                char   buffer[64 * 1024];
+                size_t bytes_read;
                 
-                // An error occured while opening/reading the file, in this case the rest
-                // of the information on the file will be printed but the md5 checksum
-                // will be replaced with an error message
-                printf("| %s (%s - %s - error computing md5: %s)\n", current_dirent->d_name, file_type_str(current_dirent->d_type), size_str, (errno == 0) ? "hash error" : strerror(errno));
+                rewind(root->output);
+                while((bytes_read = fread(buffer, 1, sizeof(buffer), root->output)) > 0) {
+                    fwrite(buffer, 1, bytes_read, stdout);
+                }
                 
+                fclose(root->output);
             }
             
-            free(size_str);
-        } else if(current_dirent->d_type == DT_LNK) {   // Symbolic links
-            
-            // Determine what the symlink points to, first a buffer is needed to hold the
-            // symlink contents, the size of which is determined by a call to lstat()
-            struct stat symlink_info;
-            if(lstat(current_dirent->d_name, &symlink_info) < 0) {
-                // If an error occured while trying to lstat the symlink, an error message
-                // will be printed to the user
-                printf("| %s (%s - error parsing symlink: %s)\n", current_dirent->d_name, file_type_str(current_dirent->d_type), strerror(errno));
-                continue;
-            }
-            
-            // Now the symlink contents can be read
-            char symlink_name[symlink_info.st_size+1];
-            symlink_name[symlink_info.st_size] = '\0';
-            
-            ssize_t symlink_size = readlink(current_dirent->d_name, symlink_name, symlink_info.st_size);
-            if(symlink_size < 0) {
-                // If an error occured while trying to read the symlink, an error message
-                // will be printed to the user
-                printf("| %s (%s - error reading symlink: %s)\n", current_dirent->d_name, file_type_str(current_dirent->d_type), strerror(errno));
-                continue;
-            }
-            
-            
-            // Determine the absolute path of the symlink
-            char* absolute_path = realpath(current_dirent->d_name, NULL);
-            if(absolute_path == NULL) {
-                // If an error occured while trying to resolve the absolute path, an error message
-                // will be printed to the user
-                printf("| %s (%s - error resolving symlink: %s)\n", current_dirent->d_name, file_type_str(current_dirent->d_type), strerror(errno));
-                continue;
+            if(root->digest_incomplete) {
+                fflush(stdout);
+                root_report_incomplete(root);
+                status = 3;
             }
-            
-            printf("| %s (%s - points to '%s', absolute path : '%s')\n", current_dirent->d_name, file_type_str(current_dirent->d_type), symlink_name, absolute_path);
-            free(absolute_path);
-        } else {                                        // Other (i.e. character devices and block devices)
-            printf("| %s (%s)\n", current_dirent->d_name, file_type_str(current_dirent->d_type));
         }
+        
+        free(root->path);
+        
+        pthread_mutex_lock(&roots_mutex);
+        roots_printed = i + 1;
+        pthread_cond_broadcast(&roots_done_cond);
+        pthread_mutex_unlock(&roots_mutex);
+    }
+    
+    // Every root was scanned, release the workers lent to the pool
+    if(scan_options.pool != NULL) {
+        gls_pool_shutdown(scan_options.pool);
+    }
+    
+    for(int i=0; i < num_workers; i++) {
+        pthread_join(workers[i], NULL);
     }
     
-    // Free memory for dirent array
-    free(entries);
+    gls_pool_free(scan_options.pool);
+    scan_options.pool = NULL;
+    
+    free(roots);
     
-    // Switch back to working directory before function call
-    fchdir(dirfd(dir_save));
-    closedir(dir_save);
+    return status;
 }
 
+/* -------- END MULTIPLE ROOT FUNCTIONS -------- */
 
-// Recursively traverses the file tree at root 'dir_path' and prints information on
-// the child directory entries including name, size, type and md5 checksum
+
+
+
+
+/* -------- MANIFEST CHECKING FUNCTIONS -------- */
+
+// In check mode ('--check MANIFEST') the tree is verified against a manifest in the
+// format written by md5sum (i.e. '<md5 checksum>  <path>' per line). The manifest is
+// loaded into a hash table keyed by path relative to the root directory, which uses
+// open addressing with linear probing. The directory walk
+// opens every listed file it finds and queues it, the files are then hashed by a pool
+// of worker threads.
+
+
+// Entry in the manifest table
+typedef struct {
+    char*         path;                         // Path relative to the root directory, NULL if slot is empty
+    unsigned char md5[GLS_DIGEST_LENGTH];       // Expected md5 checksum
+    int           seen;                         // Nonzero once the file was found in the tree
+} manifest_entry_t;
+
+
+// File queued for hashing by the worker threads
+typedef struct {
+    int               fd;
+    manifest_entry_t* entry;
+} check_job_t;
+
+
+static manifest_entry_t* manifest;
+static size_t            manifest_capacity;     // Always a power of 2
+static size_t            manifest_count;
+
+// Bounded queue of files to hash, the bound limits the number of files held open
+static check_job_t*      check_queue;
+static size_t            check_queue_capacity;
+static size_t            check_queue_head;
+static size_t            check_queue_count;
+static int               check_queue_closed;    // Set once the walk is finished
+static pthread_mutex_t   check_queue_mutex     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    check_queue_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t    check_queue_not_full  = PTHREAD_COND_INITIALIZER;
+
+// Failure counts and stop flag, protected by 'check_output_mutex' which also keeps
+// the lines printed by different threads from interleaving
+static pthread_mutex_t   check_output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long     check_mismatched;
+static unsigned long     check_missing;
+static unsigned long     check_extra;
+static int               check_stop;
+
+
+// Hashes a path string for the manifest table (FNV-1a)
 //
 // parameters:
-//      dir_path  - the path of the directory to be scanned
+//      path - the null terminated path
 //
-// returns:     void
+// returns: uint64_t
+//      hash of the path
 //
-static void parse_directory(const char* dir_path) {
-    off_t* dir_sizes = compute_dir_size(dir_path);
-    
-    int index = 0;
-    parse_directory_r(dir_path, dir_sizes, &index, 0);
+static uint64_t manifest_hash(const char* path) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(const unsigned char* c = (const unsigned char*)path; *c != '\0'; c++) {
+        hash = (hash ^ *c) * 0x100000001b3ULL;
+    }
     
-    free(dir_sizes);
+    return hash;
 }
 
 
-int main(int argc, const char * argv[]) {
-    
-    static const char* USAGE_STR = "usage: 'gls [-ah] [directory_name]'";
-    
-    // Set default options
-    filter_function = filter_hidden;
-    byte_formatter  = byte_format_identity;
+// Finds the slot for the file with the given path in the manifest table
+//
+// parameters:
+//      path - path relative to the root directory
+//
+// returns: manifest_entry_t*
+//      pointer to the slot holding the file, or to the empty slot where it should be inserted
+//
+static manifest_entry_t* manifest_slot(const char* path) {
+    size_t mask = manifest_capacity - 1;
     
-    // Check to see if user requested extended usage information
-    // by passing '--help' (i.e. help has highest precedence)
-    for(int i=1;i<argc;i++) {
-        // print usage information and exit the program
-        if(strncmp(argv[i], "--help", sizeof("--help")) == 0) {
-            printf("gls version %s\n\n", VERSION);
-            printf("%s\n", USAGE_STR);
-            printf("\ta : show hidden files and directories\n");
+    for(size_t i = (size_t)manifest_hash(path) & mask; ; i = (i + 1) & mask) {
+        manifest_entry_t* slot = &manifest[i];
+        
+        if(slot->path == NULL || strcmp(slot->path, path) == 0) {
+            return slot;
+        }
+    }
+}
+
+
+// Inserts a file into the manifest table, if the path is already listed the
+// first checksum is kept
+//
+// parameters:
+//      path      - path relative to the root directory, the table takes ownership of the string
+//      md5_bytes - the GLS_DIGEST_LENGTH bytes of the expected checksum
+//
+// returns: void
+//
+static void manifest_insert(char* path, const unsigned char* md5_bytes) {
+    // Double the capacity once the table is half full to keep probe sequences short,
+    // every entry has to be reinserted since slot positions depend on the capacity
+    if((manifest_count + 1) * 2 > manifest_capacity) {
+        manifest_entry_t* old_manifest = manifest;
+        size_t            old_capacity = manifest_capacity;
+        
+        manifest_capacity *= 2;
+        manifest = calloc(manifest_capacity, sizeof(manifest_entry_t));
+        
+        for(size_t i=0; i < old_capacity; i++) {
+            if(old_manifest[i].path != NULL) {
+                *manifest_slot(old_manifest[i].path) = old_manifest[i];
+            }
+        }
+        
+        free(old_manifest);
+    }
+    
+    manifest_entry_t* slot = manifest_slot(path);
+    if(slot->path != NULL) {
+        free(path);
+        return;
+    }
+    
+    slot->path = path;
+    slot->seen = 0;
+    memcpy(slot->md5, md5_bytes, GLS_DIGEST_LENGTH);
+    manifest_count++;
+}
+
+
+// Loads the manifest at 'path' into the manifest table. Lines are in the format
+// '<md5 checksum> <type> <path>' where the type is a space for text mode or '*'
+// for binary mode, lines starting with a backslash have '\\' and '\n' escapes in
+// the path as written by md5sum. Improperly formatted lines are reported and skipped
+//
+// parameters:
+//      path - path of the manifest file
+//
+// returns: int
+//      0 if the manifest was loaded successfully, -1 otherwise with errno set appropriately
+//
+static int manifest_load(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if(fp == NULL) {
+        return -1;
+    }
+    
+    manifest_capacity = 1024;
+    manifest_count    = 0;
+    manifest          = calloc(manifest_capacity, sizeof(manifest_entry_t));
+    
+    char*   line          = NULL;
+    size_t  line_capacity = 0;
+    ssize_t line_length;
+    
+    for(unsigned long line_number = 1; (line_length = getline(&line, &line_capacity, fp)) >= 0; line_number++) {
+        // Strip line ending
+        while(line_length > 0 && (line[line_length-1] == '\n' || line[line_length-1] == '\r')) {
+            line[--line_length] = '\0';
+        }
+        
+        if(line_length == 0) {
+            continue;
+        }
+        
+        char* cur     = line;
+        int   escaped = (*cur == '\\');
+        if(escaped) {
+            cur++;
+        }
+        
+        // Parse the checksum
+        unsigned char md5_bytes[GLS_DIGEST_LENGTH];
+        int i;
+        for(i=0; i < GLS_DIGEST_LENGTH; i++) {
+            unsigned int byte;
+            if(!isxdigit((unsigned char)cur[i*2]) || !isxdigit((unsigned char)cur[i*2 + 1]) || sscanf(cur + i*2, "%2x", &byte) != 1) {
+                break;
+            }
+            md5_bytes[i] = (unsigned char)byte;
+        }
+        cur += GLS_DIGEST_LENGTH*2;
+        
+        if(i < GLS_DIGEST_LENGTH || cur[0] != ' ' || (cur[1] != ' ' && cur[1] != '*') || cur[2] == '\0') {
+            fprintf(stderr, "gls: %s: %lu: improperly formatted md5 checksum line\n", path, line_number);
+            continue;
+        }
+        cur += 2;
+        
+        // Paths are compared without any leading './' since the walk does not produce them
+        while(cur[0] == '.' && cur[1] == '/') {
+            cur += 2;
+            while(*cur == '/') {
+                cur++;
+            }
+        }
+        
+        char* file_path = strdup(cur);
+        
+        if(escaped) {
+            char* out = file_path;
+            for(const char* in = file_path; *in != '\0'; in++) {
+                if(in[0] == '\\' && in[1] == 'n') {
+                    *out++ = '\n';
+                    in++;
+                } else if(in[0] == '\\' && in[1] == '\\') {
+                    *out++ = '\\';
+                    in++;
+                } else {
+                    *out++ = *in;
+                }
+            }
+            *out = '\0';
+        }
+        
+        manifest_insert(file_path, md5_bytes);
+    }
+    
+    free(line);
+    
+    int read_error = ferror(fp);
+    fclose(fp);
+    
+    if(read_error) {
+        errno = EIO;
+        return -1;
+    }
+    
+    return 0;
+}
+
+
+// Prints the result for a file which did not pass the check and updates the failure
+// counts, in fail fast mode further checking is stopped
+//
+// parameters:
+//      path    - path of the file relative to the root directory
+//      status  - status to print (i.e. FAILED, MISSING, EXTRA)
+//      counter - the failure count to increase
+//      error   - errno value of the error that caused the failure, 0 if none
+//
+// returns: void
+//
+static void check_report(const char* path, const char* status, unsigned long* counter, int error) {
+    pthread_mutex_lock(&check_output_mutex);
+    
+    // Once stopped nothing more is printed so the first failure is the only one reported
+    if(!check_stop) {
+        if(error != 0) {
+            printf("%s: %s (%s)\n", path, status, strerror(error));
+        } else {
+            printf("%s: %s\n", path, status);
+        }
+        
+        // Results are streamed out as they are found even when stdout is a pipe or a file
+        fflush(stdout);
+        
+        (*counter)++;
+        
+        if(check_fail_fast) {
+            check_stop = 1;
+        }
+    }
+    
+    pthread_mutex_unlock(&check_output_mutex);
+}
+
+
+// Returns whether checking should stop early because of a failure in fail fast mode
+//
+// returns: int
+//      nonzero if checking should stop, 0 otherwise
+//
+static int check_stopped(void) {
+    pthread_mutex_lock(&check_output_mutex);
+    int stopped = check_stop;
+    pthread_mutex_unlock(&check_output_mutex);
+    
+    return stopped;
+}
+
+
+// Adds a file to the queue of files to be hashed, blocking while the queue is full
+//
+// parameters:
+//      job - the file to be hashed
+//
+// returns: void
+//
+static void check_queue_push(check_job_t job) {
+    pthread_mutex_lock(&check_queue_mutex);
+    
+    while(check_queue_count == check_queue_capacity) {
+        pthread_cond_wait(&check_queue_not_full, &check_queue_mutex);
+    }
+    
+    check_queue[(check_queue_head + check_queue_count) % check_queue_capacity] = job;
+    check_queue_count++;
+    
+    pthread_cond_signal(&check_queue_not_empty);
+    pthread_mutex_unlock(&check_queue_mutex);
+}
+
+
+// Removes the next file from the queue of files to be hashed, blocking while the
+// queue is empty and the walk is not yet finished
+//
+// parameters:
+//      job - pointer to where to store the removed file
+//
+// returns: int
+//      nonzero if a file was removed, 0 if the walk is finished and the queue is empty
+//
+static int check_queue_pop(check_job_t* job) {
+    pthread_mutex_lock(&check_queue_mutex);
+    
+    while(check_queue_count == 0 && !check_queue_closed) {
+        pthread_cond_wait(&check_queue_not_empty, &check_queue_mutex);
+    }
+    
+    if(check_queue_count == 0) {
+        pthread_mutex_unlock(&check_queue_mutex);
+        return 0;
+    }
+    
+    *job = check_queue[check_queue_head];
+    check_queue_head = (check_queue_head + 1) % check_queue_capacity;
+    check_queue_count--;
+    
+    pthread_cond_signal(&check_queue_not_full);
+    pthread_mutex_unlock(&check_queue_mutex);
+    
+    return 1;
+}
+
+
+// Worker thread function, hashes queued files and compares them to the manifest
+// until the queue is closed and empty
+//
+// parameters:
+//      arg - unused
+//
+// returns: void*
+//      always NULL
+//
+static void* check_worker(void* arg) {
+    check_job_t job;
+    
+    while(check_queue_pop(&job)) {
+        if(check_stopped()) {
+            close(job.fd);
+            continue;
+        }
+        
+        struct stat entry_info;
+        unsigned char md5_bytes[GLS_DIGEST_LENGTH];
+        
+        errno = 0;
+        int result = (fstat(job.fd, &entry_info) < 0) ? -1 : gls_fdcompute_md5(job.fd, entry_info.st_blksize, md5_bytes);
+        int error  = errno;
+        
+        close(job.fd);
+        
+        if(result < 0) {
+            check_report(job.entry->path, (error == 0) ? "FAILED hash error" : "FAILED open or read", &check_mismatched, error);
+        } else if(memcmp(md5_bytes, job.entry->md5, GLS_DIGEST_LENGTH) != 0) {
+            check_report(job.entry->path, "FAILED", &check_mismatched, 0);
+        }
+    }
+    
+    return NULL;
+}
+
+
+// Returns whether an entry is hidden or inside a hidden directory
+//
+// parameters:
+//      path - path of the entry relative to the root directory
+//
+// returns: int
+//      nonzero if any component of the path starts with '.', 0 otherwise
+//
+static int path_is_hidden(const char* path) {
+    return path[0] == '.' || strstr(path, "/.") != NULL;
+}
+
+
+// Opens a file listed in the manifest and queues it for hashing, following symbolic links.
+// The file is opened without blocking and only queued if it is a regular file, so a listed
+// path which is (or points to) a FIFO or a device cannot stall the walk
+//
+// parameters:
+//      dir_fd         - file descriptor of the directory 'path' is relative to
+//      path           - path of the file relative to 'dir_fd'
+//      manifest_entry - the manifest entry of the file
+//
+// returns: void
+//
+static void check_queue_file(int dir_fd, const char* path, manifest_entry_t* manifest_entry) {
+    struct stat file_info;
+    
+    int fd = openat(dir_fd, path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0) {
+        check_report(manifest_entry->path, "FAILED open or read", &check_mismatched, errno);
+        return;
+    }
+    
+    if(fstat(fd, &file_info) < 0) {
+        check_report(manifest_entry->path, "FAILED open or read", &check_mismatched, errno);
+        close(fd);
+        return;
+    }
+    
+    if(S_ISDIR(file_info.st_mode)) {
+        check_report(manifest_entry->path, "FAILED open or read", &check_mismatched, EISDIR);
+        close(fd);
+        return;
+    }
+    
+    if(!S_ISREG(file_info.st_mode)) {
+        check_report(manifest_entry->path, "FAILED not a regular file", &check_mismatched, 0);
+        close(fd);
+        return;
+    }
+    
+    check_queue_push((check_job_t){ fd, manifest_entry });
+}
+
+
+// Visitor callback for gls_scan(), reports directories which could not be read, the
+// listed files in such a directory will be reported missing
+//
+// parameters:
+//      entry   - the directory
+//      context - unused
+//
+// returns: int
+//      nonzero to stop the scan if checking was stopped, 0 otherwise
+//
+static int check_enter_directory(const gls_entry_t* entry, void* context) {
+    if(entry->error == GLS_ERROR_SCAN_DIRECTORY) {
+        fprintf(stderr, "gls: Error accessing '%s': %s\n", (entry->depth > 0) ? entry->path : entry->name, strerror(entry->error_number));
+    }
+    
+    return check_stopped();
+}
+
+
+// Visitor callback for gls_scan(), queues regular files listed in the manifest for
+// hashing and reports regular files which are not listed. Listed symbolic links are
+// hashed as the file they point to like md5sum does, unlisted ones are not reported
+// since manifests are usually made of regular files only (i.e. 'find -type f')
+//
+// parameters:
+//      entry   - the entry
+//      context - unused
+//
+// returns: int
+//      nonzero to stop the scan if checking was stopped, 0 otherwise
+//
+static int check_visit_entry(const gls_entry_t* entry, void* context) {
+    if(entry->type != DT_REG && entry->type != DT_LNK) {
+        return check_stopped();
+    }
+    
+    manifest_entry_t* manifest_entry = manifest_slot(entry->path);
+    
+    if(manifest_entry->path == NULL) {
+        // Hidden files not in the manifest are only reported when hidden files are shown
+        if(entry->type == DT_REG && (scan_options.show_hidden || !path_is_hidden(entry->path))) {
+            check_report(entry->path, "EXTRA", &check_extra, 0);
+        }
+    } else {
+        manifest_entry->seen = 1;
+        
+        // Symbolic links are followed when opened
+        check_queue_file(entry->dir_fd, entry->name, manifest_entry);
+    }
+    
+    return check_stopped();
+}
+
+
+// Verifies the file tree at root 'dir_path' against the manifest at 'manifest_path',
+// printing every file which does not match its checksum, every listed file which is
+// missing from the tree and every file in the tree which is not listed
+//
+// parameters:
+//      dir_path      - the path of the directory to be checked
+//      manifest_path - the path of the manifest
+//
+// returns: int
+//      0 if every file matched, 3 if the manifest could not be read, 4 if any file failed
+//
+static int check_directory(const char* dir_path, const char* manifest_path) {
+    if(manifest_load(manifest_path) < 0) {
+        fprintf(stderr, "gls: Error reading manifest '%s': %s\n", manifest_path, strerror(errno));
+        return 3;
+    }
+    
+    // Start the workers, the queue holds a few files per worker so no worker waits on the walk
+    check_queue_capacity = (size_t)num_jobs * 4;
+    check_queue          = malloc(sizeof(check_job_t) * check_queue_capacity);
+    
+    pthread_t workers[num_jobs];
+    for(int i=0; i < num_jobs; i++) {
+        pthread_create(&workers[i], NULL, check_worker, NULL);
+    }
+    
+    // Every entry is walked since listed files may be hidden, only listed files are hashed
+    // and the order of the walk does not matter since files finish hashing in any order
+    gls_options_t check_options;
+    gls_options_init(&check_options);
+    check_options.show_hidden = 1;
+    check_options.hash_files  = 0;
+    check_options.dir_sizes   = 0;
+    check_options.sort        = GLS_SORT_NONE;
+    
+    gls_visitor_t visitor = { check_enter_directory, NULL, check_visit_entry, NULL };
+    gls_scan(dir_path, &check_options, &visitor);
+    
+    // The walk does not follow symbolic links to directories, so listed files it did not
+    // find are opened from the root following links (as md5sum does) before they are
+    // reported missing
+    int root_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    
+    for(size_t i=0; i < manifest_capacity && root_fd >= 0 && !check_stopped(); i++) {
+        struct stat file_info;
+        
+        if(manifest[i].path == NULL || manifest[i].seen) {
+            continue;
+        }
+        
+        if(fstatat(root_fd, manifest[i].path, &file_info, 0) < 0 && (errno == ENOENT || errno == ENOTDIR)) {
+            continue;
+        }
+        
+        manifest[i].seen = 1;
+        check_queue_file(root_fd, manifest[i].path, &manifest[i]);
+    }
+    
+    // Let the workers finish the remaining files
+    pthread_mutex_lock(&check_queue_mutex);
+    check_queue_closed = 1;
+    pthread_cond_broadcast(&check_queue_not_empty);
+    pthread_mutex_unlock(&check_queue_mutex);
+    
+    for(int i=0; i < num_jobs; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    
+    if(root_fd >= 0) {
+        close(root_fd);
+    }
+    
+    // Every listed file that was not found is missing
+    for(size_t i=0; i < manifest_capacity; i++) {
+        if(manifest[i].path != NULL && !manifest[i].seen) {
+            check_report(manifest[i].path, "MISSING", &check_missing, 0);
+        }
+    }
+    
+    if(check_mismatched + check_missing + check_extra > 0) {
+        fprintf(stderr, "gls: %lu mismatched, %lu missing, %lu extra\n", check_mismatched, check_missing, check_extra);
+    }
+    
+    for(size_t i=0; i < manifest_capacity; i++) {
+        free(manifest[i].path);
+    }
+    free(manifest);
+    free(check_queue);
+    
+    return (check_mismatched + check_missing + check_extra > 0) ? 4 : 0;
+}
+
+/* -------- END MANIFEST CHECKING FUNCTIONS -------- */
+
+
+int main(int argc, const char * argv[]) {
+    
+    static const char* USAGE_STR = "usage: 'gls [-adh] [--cache=FILE] [--sort=KEY] [--check MANIFEST [--fail-fast]] [--jobs=N] [--roots-from=FILE] [directory_name ...]'";
+    
+    // Set default options
+    gls_options_init(&scan_options);
+    byte_formatter = byte_format_identity;
+    num_jobs       = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    
+    if(num_jobs < 1) {
+        num_jobs = 1;
+    }
+    
+    const char* check_path  = NULL;
+    int         roots_files = 0;    // Number of '--roots-from' files given
+    
+    // Check to see if user requested extended usage information
+    // by passing '--help' (i.e. help has highest precedence)
+    for(int i=1;i<argc;i++) {
+        // print usage information and exit the program
+        if(strncmp(argv[i], "--help", sizeof("--help")) == 0) {
+            printf("gls version %s\n\n", VERSION);
+            printf("%s\n", USAGE_STR);
+            printf("\ta : show hidden files and directories\n");
+            printf("\td : display a merkle digest for each directory computed from its entries\n");
             printf("\th : display file sizes in human readable format (i.e. KB, MB, GB)\n");
+            printf("\t--cache=FILE : reuse md5 checksums of unchanged files stored in FILE by a previous run\n");
+            printf("\t--sort=KEY   : order entries by KEY, one of name-bytes (default), size (largest first),\n");
+            printf("\t               mtime (newest first) or none (order entries are read from the directory)\n");
+            printf("\t--check MANIFEST : verify the files in the directory against an md5sum style manifest instead\n");
+            printf("\t                   of listing them, printing files which are FAILED, MISSING or EXTRA\n");
+            printf("\t--fail-fast      : stop checking at the first failure\n");
+            printf("\t--jobs=N         : number of threads used to scan directories and hash files (default: number of CPUs)\n");
+            printf("\t--roots-from=FILE : also list the directories named in FILE, one per line ('-' for standard input)\n");
             
             return 0;
         }
     }
     
     // Parse arguments
-    int dir_arg_index = 0;
     for(int i=1;i<argc;i++) {
         
-        if(argv[i][0] == '-') {     // Argument contains options
+        if(strncmp(argv[i], "--cache=", sizeof("--cache=") - 1) == 0) {    // Hash cache file
+            
+            scan_options.cache_path = argv[i] + sizeof("--cache=") - 1;
+            
+            if(*scan_options.cache_path == '\0') {
+                fprintf(stderr, "gls: option '--cache' requires a file name\n");
+                fprintf(stderr, "%s\n", USAGE_STR);
+                fprintf(stderr, "Try 'gls --help' for more info\n");
+                
+                return 1;
+            }
+            
+        } else if(strncmp(argv[i], "--check", sizeof("--check")) == 0) {     // Manifest to check against
+            
+            if(i + 1 >= argc) {
+                fprintf(stderr, "gls: option '--check' requires a manifest file\n");
+                fprintf(stderr, "%s\n", USAGE_STR);
+                fprintf(stderr, "Try 'gls --help' for more info\n");
+                
+                return 1;
+            }
+            
+            check_path = argv[++i];
+            
+        } else if(strncmp(argv[i], "--fail-fast", sizeof("--fail-fast")) == 0) {     // Stop checking at first failure
+            
+            check_fail_fast = 1;
+            
+        } else if(strncmp(argv[i], "--jobs=", sizeof("--jobs=") - 1) == 0) {     // Number of hashing threads
+            
+            char* end;
+            long  jobs = strtol(argv[i] + sizeof("--jobs=") - 1, &end, 10);
+            
+            if(*end != '\0' || end == argv[i] + sizeof("--jobs=") - 1 || jobs < 1 || jobs > 1024) {
+                fprintf(stderr, "gls: invalid number of jobs '%s'\n", argv[i] + sizeof("--jobs=") - 1);
+                fprintf(stderr, "%s\n", USAGE_STR);
+                fprintf(stderr, "Try 'gls --help' for more info\n");
+                
+                return 1;
+            }
+            
+            num_jobs = (int)jobs;
+            
+        } else if(strncmp(argv[i], "--roots-from=", sizeof("--roots-from=") - 1) == 0) {     // File listing directories
+            
+            const char* roots_path = argv[i] + sizeof("--roots-from=") - 1;
+            
+            if(roots_load(roots_path) < 0) {
+                fprintf(stderr, "gls: Error reading '%s': %s\n", roots_path, strerror(errno));
+                
+                return 3;
+            }
+            
+            roots_files++;
+            
+        } else if(strncmp(argv[i], "--sort=", sizeof("--sort=") - 1) == 0) {     // Sort order
+            
+            const char* sort_key = argv[i] + sizeof("--sort=") - 1;
+            
+            if(strcmp(sort_key, "name-bytes") == 0) {
+                scan_options.sort = GLS_SORT_NAME_BYTES;
+            } else if(strcmp(sort_key, "size") == 0) {
+                scan_options.sort = GLS_SORT_SIZE;
+            } else if(strcmp(sort_key, "mtime") == 0) {
+                scan_options.sort = GLS_SORT_MTIME;
+            } else if(strcmp(sort_key, "none") == 0) {
+                scan_options.sort = GLS_SORT_NONE;
+            } else {
+                fprintf(stderr, "gls: invalid sort key '%s'\n", sort_key);
+                fprintf(stderr, "%s\n", USAGE_STR);
+                fprintf(stderr, "Try 'gls --help' for more info\n");
+                
+                return 1;
+            }
+            
+        } else if(argv[i][0] == '-') {     // Argument contains options
             
             // If the argument contains no options (i.e. just '-') this is invalid,
             // print a message to the user indicating incorrect usage and then print
@@ -689,14 +1458,21 @@ int main(int argc, const char * argv[]) {
                 
                 switch (option) {
                         
-                    // If the user specified the '-a' argument then set the filter function
-                    // to only filter parent and current directory (i.e. show hidden directories
-                    // and files) default is to hide hidden files and directories
+                    // If the user specified the '-a' argument then only filter parent and current
+                    // directory (i.e. show hidden directories and files) default is to hide hidden
+                    // files and directories
                     case 'a':
-                        filter_function = filter_show_hidden;
+                        scan_options.show_hidden = 1;
                         break;
                       
                         
+                    // If the user specified the '-d' argument then compute a merkle digest for
+                    // every directory and print it after the directory size
+                    case 'd':
+                        scan_options.digests = 1;
+                        break;
+                        
+                        
                     // If the user specified the '-h' argument then
                     case 'h':
                         byte_formatter = byte_format_human;
@@ -716,41 +1492,69 @@ int main(int argc, const char * argv[]) {
             
         } else {
             
-            // If multiple directory arguments are passed print an error message
-            // indicating the ambuiguity and exit the program after printing
-            // usage information
-            if(dir_arg_index != 0) {
-                fprintf(stderr, "gls: Please specify only one directory\n");
-                fprintf(stderr, "%s\n", USAGE_STR);
-                fprintf(stderr, "Try 'gls --help' for more info\n");
-                
-                return 2;
-            }
+            // Every other argument is a directory to be listed
+            root_add(argv[i]);
             
-            // Set directory argument index to potential directory path
-            dir_arg_index = i;
+        }
+        
+    }
+    
+    // If no directory argument was given then assume user requested information
+    // on the current working directory (i.e. '.'), unless the directories were to
+    // come from files which listed none in which case there is nothing to list
+    if(roots_count == 0 && roots_files == 0) {
+        root_add(".");
+    }
+    
+    // Verify the directory against the manifest instead of listing it
+    if(check_path != NULL) {
+        
+        // Paths in the manifest are relative to a single root directory
+        if(roots_count != 1) {
+            fprintf(stderr, "gls: option '--check' takes only one directory\n");
+            fprintf(stderr, "%s\n", USAGE_STR);
+            fprintf(stderr, "Try 'gls --help' for more info\n");
             
+            return 2;
         }
         
+        // Check if argument is accessible directory or not
+        DIR* dir = opendir(roots[0].path);
+        if(dir == NULL) {
+            // If there was an error trying to access the specified directory print an
+            // error message indicating why and exit the program
+            fprintf(stderr, "gls: Error accessing '%s': %s\n", roots[0].path, strerror(errno));
+            
+            return 3;
+        }
+        closedir(dir);
+        
+        return check_directory(roots[0].path, check_path);
     }
     
-    // Check if argument is accessible directory or not, if no directory
-    // argument was given then assume user requested information on the
-    // current working directory (i.e. '.')
-    const char* dir_path = (dir_arg_index != 0) ? argv[dir_arg_index] : ".";
+    if(roots_count == 0) {
+        return 0;
+    }
     
-    DIR* dir = opendir(dir_path);
-    if(dir == NULL) {
-        // If there was an error trying to access the specified directory print an
-        // error message indicating why and exit the program
-        fprintf(stderr, "gls: Error accessing '%s': %s\n", dir_path, strerror(errno));
+    // One hash cache is shared by all roots. Unless every checksum is needed again (for
+    // the digests or the cache file) it only keeps hard linked files, which are then
+    // hashed once however many of the roots they are linked into
+    int hard_links_only = !scan_options.digests && scan_options.cache_path == NULL;
+    scan_options.cache  = gls_cache_create(scan_options.cache_path, hard_links_only);
+    
+    // Traverse and parse given directories
+    int status = list_roots();
+    
+    if(scan_options.cache_path != NULL && scan_options.cache != NULL &&
+       gls_cache_save(scan_options.cache, scan_options.cache_path) < 0) {
+        fprintf(stderr, "gls: Error writing cache '%s': %s\n", scan_options.cache_path, strerror(errno));
         
-        return 3;
+        if(status == 0) {
+            status = 3;
+        }
     }
-    closedir(dir);
     
-    // Traverse and parse given directory
-    parse_directory(dir_path);
+    gls_cache_free(scan_options.cache);
     
-    return 0;
+    return status;
 }
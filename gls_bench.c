@@ -0,0 +1,251 @@
+//
+//  gls_bench.c
+//
+//  compile with:
+//      Linux:  gcc -Wall gls_bench.c libgls.c -o gls_bench -lssl -lcrypto -lpthread
+//      OS X:   gcc -Wall gls_bench.c libgls.c -o gls_bench
+//
+//
+// Description:
+// ---------------------------------------------------------------------------------------------------
+//
+// Benchmark of the two ways of getting the entries of a tree into a program, scanning
+// it in process with libgls or running gls and parsing its output. Both ways are timed
+// over the same number of runs and must agree on the number of entries and the total
+// size of the regular files, otherwise the benchmark fails. The gls binary is expected
+// in the working directory (i.e. run from the directory gls was built in). Both ways
+// hash on a single thread, gls is run with '--jobs=1' since the in process scan has no
+// hashing pool, so only the cost of running gls and parsing its output is compared.
+//
+//
+// usage: 'gls_bench [-n runs] [directory_name]'
+//     n : number of times each way is run (default: 10)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "libgls.h"
+
+
+// Totals gathered by one run, used to check that both ways saw the same tree
+typedef struct {
+    long      num_entries;
+    long long total_size;
+} bench_totals_t;
+
+
+// Returns the current time in seconds from a monotonic clock
+//
+// returns: double
+//      seconds since an arbitrary point in time
+//
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// Visitor callback for gls_scan(), counts a directory other than the root
+//
+// parameters:
+//      entry   - the directory
+//      context - pointer to the bench_totals_t of the run
+//
+// returns: int
+//      always 0 to continue the scan
+//
+static int count_directory(const gls_entry_t* entry, void* context) {
+    if(entry->depth >= 1) {
+        ((bench_totals_t*)context)->num_entries++;
+    }
+    
+    return 0;
+}
+
+
+// Visitor callback for gls_scan(), counts an entry which is not a directory
+//
+// parameters:
+//      entry   - the entry
+//      context - pointer to the bench_totals_t of the run
+//
+// returns: int
+//      always 0 to continue the scan
+//
+static int count_entry(const gls_entry_t* entry, void* context) {
+    bench_totals_t* totals = context;
+    
+    totals->num_entries++;
+    if(entry->type == DT_REG && entry->size >= 0) {
+        totals->total_size += entry->size;
+    }
+    
+    return 0;
+}
+
+
+// Scans the tree in process with libgls
+//
+// parameters:
+//      dir_path - the path of the directory to be scanned
+//      totals   - pointer to where to store the totals of the run
+//
+// returns: int
+//      0 on success, -1 on failure
+//
+static int run_in_process(const char* dir_path, bench_totals_t* totals) {
+    gls_options_t options;
+    gls_options_init(&options);
+    
+    gls_visitor_t visitor = { count_directory, NULL, count_entry, totals };
+    
+    return (gls_scan(dir_path, &options, &visitor) == 0) ? 0 : -1;
+}
+
+
+// Runs gls on the tree and parses its output, each line is '| name (type - size - md5)'
+// preceded by indentation, where only regular files have a size followed by an md5
+// checksum. Names containing ' (' are not supported. gls is run directly rather than
+// through the shell so the directory name is passed as is whatever characters it holds,
+// and with a single thread like run_in_process()
+//
+// parameters:
+//      dir_path - the path of the directory to be scanned
+//      totals   - pointer to where to store the totals of the run
+//
+// returns: int
+//      0 on success, -1 on failure
+//
+static int run_exec_parse(const char* dir_path, bench_totals_t* totals) {
+    int pipe_fds[2];
+    if(pipe(pipe_fds) < 0) {
+        return -1;
+    }
+    
+    pid_t pid = fork();
+    if(pid < 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return -1;
+    }
+    
+    if(pid == 0) {
+        // Child, send the output of gls into the pipe
+        close(pipe_fds[0]);
+        if(dup2(pipe_fds[1], STDOUT_FILENO) < 0) {
+            _exit(127);
+        }
+        close(pipe_fds[1]);
+        
+        execl("./gls", "gls", "--jobs=1", dir_path, (char*)NULL);
+        _exit(127);
+    }
+    
+    close(pipe_fds[1]);
+    
+    FILE* fp = fdopen(pipe_fds[0], "r");
+    if(fp == NULL) {
+        close(pipe_fds[0]);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+    
+    char line[8192];
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        char* entry = strstr(line, "| ");
+        if(entry == NULL) {
+            continue;   // '*** empty directory ***'
+        }
+        
+        char* info = strstr(entry, " (");
+        if(info == NULL) {
+            continue;
+        }
+        
+        totals->num_entries++;
+        
+        long long size;
+        if(strncmp(info, " (regular file - ", sizeof(" (regular file - ") - 1) == 0 &&
+           sscanf(info + sizeof(" (regular file - ") - 1, "%lld", &size) == 1) {
+            totals->total_size += size;
+        }
+    }
+    
+    fclose(fp);
+    
+    int status;
+    if(waitpid(pid, &status, 0) < 0) {
+        return -1;
+    }
+    
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+
+int main(int argc, const char * argv[]) {
+    
+    static const char* USAGE_STR = "usage: 'gls_bench [-n runs] [directory_name]'";
+    
+    const char* dir_path = ".";
+    int         num_runs = 10;
+    
+    // Parse arguments
+    for(int i=1;i<argc;i++) {
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            num_runs = atoi(argv[++i]);
+        } else if(argv[i][0] != '-') {
+            dir_path = argv[i];
+        } else {
+            fprintf(stderr, "%s\n", USAGE_STR);
+            return 1;
+        }
+    }
+    
+    if(num_runs < 1) {
+        fprintf(stderr, "gls_bench: number of runs must be at least 1\n");
+        return 1;
+    }
+    
+    // Run each way once before timing so both start with the tree in the page cache
+    bench_totals_t in_process = {0, 0};
+    bench_totals_t exec_parse = {0, 0};
+    
+    if(run_in_process(dir_path, &in_process) < 0 || run_exec_parse(dir_path, &exec_parse) < 0) {
+        fprintf(stderr, "gls_bench: Error scanning '%s'\n", dir_path);
+        return 3;
+    }
+    
+    if(in_process.num_entries != exec_parse.num_entries || in_process.total_size != exec_parse.total_size) {
+        fprintf(stderr, "gls_bench: results differ, in process: %ld entries %lld bytes, exec+parse: %ld entries %lld bytes\n",
+                in_process.num_entries, in_process.total_size, exec_parse.num_entries, exec_parse.total_size);
+        return 4;
+    }
+    
+    double start = now_seconds();
+    for(int i=0; i < num_runs; i++) {
+        bench_totals_t totals = {0, 0};
+        run_in_process(dir_path, &totals);
+    }
+    double in_process_time = (now_seconds() - start) / num_runs;
+    
+    start = now_seconds();
+    for(int i=0; i < num_runs; i++) {
+        bench_totals_t totals = {0, 0};
+        run_exec_parse(dir_path, &totals);
+    }
+    double exec_parse_time = (now_seconds() - start) / num_runs;
+    
+    printf("%s: %ld entries, %lld bytes, %d runs\n", dir_path, in_process.num_entries, in_process.total_size, num_runs);
+    printf("in process:  %10.3f ms per scan\n", in_process_time * 1000);
+    printf("exec+parse:  %10.3f ms per scan\n", exec_parse_time * 1000);
+    printf("speedup:     %10.2fx\n", exec_parse_time / in_process_time);
+    
+    return 0;
+}
@@ -0,0 +1,2238 @@
+//
+//  libgls.c
+//
+//  compile with:
+//      Linux:  gcc -Wall -fPIC -c libgls.c -o libgls.o
+//      OS X:   gcc -Wall -fPIC -c libgls.c -o libgls.o
+//
+//
+// Description:
+// ---------------------------------------------------------------------------------------------------
+//
+// Implementation of libgls, see libgls.h. The tree is walked twice, first to compute
+// the sizes (and digests) of the directories bottom up and then to visit the entries,
+// since a directory is visited before its entries but its size depends on all of them.
+// The sizes are looked up by the inode of each directory rather than by position, so
+// the listing is correct even if directories change between the two walks.
+//
+// Directories are opened relative to the file descriptor of their parent directory
+// (i.e. openat() and fstatat()) rather than by changing the working directory, which
+// is shared by every thread of the process.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "libgls.h"
+
+
+// Minimum number of bytes read at once when computing md5 checksums
+#define HASH_READ_SIZE (128 * 1024)
+
+
+#ifdef __APPLE__
+
+    // Starting with OS X Yosemite Apple removed the OpenSSL developement headers and
+    // switched to using their own CommonCrypto library to replace OpenSSL. Luckily
+    // CommonCrypto has an almost identical interface to OpenSSL which allows this
+    // simple hack below to emulate some of the OpenSSL MD5 interface using the
+    // CommonCrypto MD5 hash functions
+
+    #include <CommonCrypto/CommonCrypto.h>
+
+    #define MD5_DIGEST_LENGTH CC_MD5_DIGEST_LENGTH
+
+    typedef CC_MD5_CTX MD5_CTX;
+
+    // Function pointers to map OpenSSL MD5 hash functions to CommonCrypto
+    // MD5 hash functions
+    static int(* const MD5_Init)(MD5_CTX*) = CC_MD5_Init;
+    static int(* const MD5_Update)(MD5_CTX*, const void*, unsigned int) = CC_MD5_Update;
+    static int(* const MD5_Final)(unsigned char*, MD5_CTX*) = CC_MD5_Final;
+
+    // Nanosecond timestamps are named differently in the Darwin stat struct
+    #define STAT_MTIM(st) ((st).st_mtimespec)
+    #define STAT_CTIM(st) ((st).st_ctimespec)
+
+#elif defined __linux__
+    #include <openssl/md5.h>
+
+    #define STAT_MTIM(st) ((st).st_mtim)
+    #define STAT_CTIM(st) ((st).st_ctim)
+#else
+    #error Missing crypto library for MD5 hash (OpenSSL or CommonCrypto required)
+#endif
+
+#if MD5_DIGEST_LENGTH != GLS_DIGEST_LENGTH
+    #error GLS_DIGEST_LENGTH does not match MD5_DIGEST_LENGTH
+#endif
+
+
+// Byte filling the contents digest of an entry which could not be read, so a tree with
+// unreadable entries does not digest the same as one where they are empty
+#define DIGEST_ERROR_BYTE 0xFF
+
+
+
+// Information gathered for each directory by compute_dir_size(), identified by the
+// device and inode number of the directory
+typedef struct {
+    dev_t         dev;
+    ino_t         ino;
+    off_t         size;                         // Total size in bytes of all regular files in the subtree
+    unsigned char digest[MD5_DIGEST_LENGTH];    // Merkle digest of the subtree (only computed for digests)
+    int           incomplete;                   // Nonzero if an entry of the subtree could not be read
+    int           used;                         // 0 if slot is empty
+} dir_info_t;
+
+
+// Table of the directory information gathered by compute_dir_size(), looked up by
+// parse_directory() by inode so the two passes need not read directories in the
+// same order (see dir_info_slot())
+typedef struct {
+    dir_info_t* slots;
+    size_t      capacity;       // Always a power of 2
+    size_t      count;
+} dir_info_table_t;
+
+
+// Entry in the file hash cache, an md5 checksum is only reused if the size and
+// timestamps of the file are the same as when the checksum was computed
+typedef struct {
+    dev_t           dev;
+    ino_t           ino;
+    off_t           size;
+    struct timespec mtime;
+    struct timespec ctime;
+    unsigned char   md5[MD5_DIGEST_LENGTH];
+    int             state;          // 0 if slot is empty, 1 if loaded from cache file, 2 if seen this run,
+                                    // 3 while the file is being hashed
+} hash_cache_entry_t;
+
+
+// State of a single call to gls_scan()
+typedef struct {
+    const gls_options_t* options;
+    const gls_visitor_t* visitor;
+    const char*          root_path;
+    
+    // Function to use to filter directory entries when visiting them
+    int(* filter_function)(const struct dirent*);
+    
+    // Function to compute the sort key of a directory entry, NULL keeps entries in
+    // the order they are read from the directory
+    uint64_t(* sort_key_function)(dir_info_table_t*, int, const struct dirent*);
+    
+    // Path of the current entry relative to the root directory
+    char*                path;
+    size_t               path_length;
+    size_t               path_capacity;
+    
+    // File hash cache, NULL if not used. Either the shared cache from the options or
+    // one owned by the scan (see 'owns_hash_cache')
+    gls_cache_t*         hash_cache;
+    int                  owns_hash_cache;
+    
+    // Nonzero value returned by the callback which stopped the scan, 0 while running
+    int                  result;
+} gls_scan_t;
+
+
+
+
+/* -------- FILE/DIRECTORY FILTERING FUNCTIONS -------- */
+
+
+// Filter function for scan_directory(), filters out hidden files and directories
+//
+// parameters:
+//      entry - the directory entry to be tested
+//
+// returns: int
+//      0 if directory entry is hidden, nonzero otherwise
+//
+static int filter_hidden(const struct dirent* entry) {
+    return (entry->d_name[0] == '.') ? 0 : 1;
+}
+
+// Filter function for scan_directory(), filters out only parent and current directory ('.' and '..')
+//
+// parameters:
+//      entry - the directory entry to be tested
+//
+// returns: int
+//      0 if directory entry is parent ('..') or current ('.'), nonzero otherwise
+//
+static int filter_show_hidden(const struct dirent* entry) {
+    return ( strncmp(entry->d_name, ".", 2) == 0 || strncmp(entry->d_name, "..", 3) == 0 ) ? 0 : 1;
+}
+
+/* -------- END FILE/DIRECTORY FILTERING FUNCTIONS -------- */
+
+
+
+
+/* -------- DIRECTORY SORTING FUNCTIONS -------- */
+
+// Directory entries are sorted on a 64 bit key computed once per entry when the
+// directory is read, so most comparisons are a single integer compare instead of
+// a string compare (or a locale aware strcoll() in the case of alphasort). Entries
+// with equal keys are ordered by name in byte order so the order is always total.
+// Only parse_directory() sorts, compute_dir_size() reads directories unsorted since
+// the sizes it computes are looked up by inode rather than by position.
+
+
+// Directory entry together with its precomputed sort key
+typedef struct {
+    uint64_t       key;
+    struct dirent* dirent;
+} sort_record_t;
+
+
+// Defined with the other directory information functions below
+static dir_info_t* dir_info_slot(dir_info_table_t* table, dev_t dev, ino_t ino);
+
+
+// Sort key function, orders entries by name in byte order. The key holds the first
+// 8 bytes of the name in big-endian order (zero padded) so comparing keys is the same
+// as comparing the name prefixes with strcmp()
+//
+// parameters:
+//      dir_infos - sizes of the directories computed so far, unused
+//      dir_fd    - file descriptor of the directory containing the entry
+//      entry     - the directory entry to compute the key for
+//
+// returns: uint64_t
+//      the sort key of the entry
+//
+static uint64_t sort_key_name_bytes(dir_info_table_t* dir_infos, int dir_fd, const struct dirent* entry) {
+    uint64_t key = 0;
+    
+    const unsigned char* name = (const unsigned char*)entry->d_name;
+    for(int i=0; i < 8; i++) {
+        key <<= 8;
+        if(*name != '\0') {
+            key |= *name++;
+        }
+    }
+    
+    return key;
+}
+
+
+// Sort key function, orders entries by size largest first. Directories are ordered by
+// the size of their contents (the size visited for them) when it was computed, other
+// entries by the size of the entry itself as for 'ls -S'. Entries which cannot be
+// stat'ed are placed last
+//
+// parameters:
+//      dir_infos - sizes of the directories computed so far, NULL if none
+//      dir_fd    - file descriptor of the directory containing the entry
+//      entry     - the directory entry to compute the key for
+//
+// returns: uint64_t
+//      the sort key of the entry
+//
+static uint64_t sort_key_size(dir_info_table_t* dir_infos, int dir_fd, const struct dirent* entry) {
+    struct stat entry_info;
+    if(fstatat(dir_fd, entry->d_name, &entry_info, AT_SYMLINK_NOFOLLOW) < 0) {
+        return UINT64_MAX;
+    }
+    
+    if(dir_infos != NULL && S_ISDIR(entry_info.st_mode)) {
+        dir_info_t* slot = dir_info_slot(dir_infos, entry_info.st_dev, entry_info.st_ino);
+        
+        if(slot->used) {
+            return ~(uint64_t)slot->size;
+        }
+    }
+    
+    return ~(uint64_t)entry_info.st_size;
+}
+
+
+// Sort key function, orders entries by modification time newest first. Entries
+// which cannot be stat'ed are placed last
+//
+// parameters:
+//      dir_infos - sizes of the directories computed so far, unused
+//      dir_fd    - file descriptor of the directory containing the entry
+//      entry     - the directory entry to compute the key for
+//
+// returns: uint64_t
+//      the sort key of the entry
+//
+static uint64_t sort_key_mtime(dir_info_table_t* dir_infos, int dir_fd, const struct dirent* entry) {
+    struct stat entry_info;
+    if(fstatat(dir_fd, entry->d_name, &entry_info, AT_SYMLINK_NOFOLLOW) < 0 || STAT_MTIM(entry_info).tv_sec < 0) {
+        return UINT64_MAX;
+    }
+    
+    // Nanoseconds fit in 30 bits which leaves 34 bits for the seconds
+    return ~( ((uint64_t)STAT_MTIM(entry_info).tv_sec << 30) | (uint64_t)STAT_MTIM(entry_info).tv_nsec );
+}
+
+
+// Comparison function for qsort(), compares sort records by key and then by name
+//
+// parameters:
+//      a - pointer to the first sort record
+//      b - pointer to the second sort record
+//
+// returns: int
+//      negative if 'a' is ordered before 'b', positive if 'a' is ordered after 'b', 0 if equal
+//
+static int compare_sort_records(const void* a, const void* b) {
+    const sort_record_t* record_a = a;
+    const sort_record_t* record_b = b;
+    
+    if(record_a->key != record_b->key) {
+        return (record_a->key < record_b->key) ? -1 : 1;
+    }
+    
+    return strcmp(record_a->dirent->d_name, record_b->dirent->d_name);
+}
+
+
+// Opens a directory relative to the directory 'parent_fd'
+//
+// parameters:
+//      parent_fd - file descriptor of the parent directory, or AT_FDCWD
+//      name      - name of the directory in the parent directory
+//
+// returns: int
+//      file descriptor of the directory, or -1 if it could not be opened in which case
+//      errno is set appropriately
+//
+static int open_directory(int parent_fd, const char* name) {
+    return openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+
+// Opens a directory stream on a duplicate of 'dir_fd', since the stream takes ownership
+// of its descriptor
+//
+// parameters:
+//      dir_fd - file descriptor of the directory, remains open
+//
+// returns: DIR*
+//      the directory stream to be closed with closedir(), or NULL if it could not be opened
+//      in which case errno is set appropriately
+//
+static DIR* open_directory_stream(int dir_fd) {
+    int stream_fd = dup(dir_fd);
+    if(stream_fd < 0) {
+        return NULL;
+    }
+    
+    DIR* dir = fdopendir(stream_fd);
+    if(dir == NULL) {
+        int open_errno = errno;
+        close(stream_fd);
+        errno = open_errno;
+    }
+    
+    return dir;
+}
+
+
+// Copies a directory entry returned by readdir(), which is only valid until the next call
+//
+// parameters:
+//      entry - the directory entry
+//
+// returns: struct dirent*
+//      the copy of the entry, must be freed using free()
+//
+static struct dirent* copy_dirent(const struct dirent* entry) {
+    // Only copy the used part of the entry since d_name is usually much shorter than its maximum length
+    size_t entry_size = offsetof(struct dirent, d_name) + strlen(entry->d_name) + 1;
+    
+    struct dirent* copy = malloc(entry_size);
+    memcpy(copy, entry, entry_size);
+    
+    return copy;
+}
+
+
+// Reads the entries of a directory into an array like scandir(), sorted using the
+// sort key function. If no sort key function is given the entries are left in the
+// order they were read from the directory
+//
+// parameters:
+//      dir_fd            - file descriptor of the directory, remains open
+//      namelist          - pointer to where to store the array of entries, each entry and
+//                          the array itself must be freed using free()
+//      filter            - filter function, entries for which it returns 0 are skipped
+//      sort_key_function - function computing the sort key of an entry, NULL for no sorting
+//      dir_infos         - sizes of the directories passed to the sort key function, may be NULL
+//
+// returns: int
+//      the number of entries in the array, or -1 if the directory could not be read in which
+//      case errno is set appropriately
+//
+static int scan_directory(int dir_fd, struct dirent*** namelist, int(* filter)(const struct dirent*),
+                          uint64_t(* sort_key_function)(dir_info_table_t*, int, const struct dirent*), dir_info_table_t* dir_infos) {
+    DIR* dir = open_directory_stream(dir_fd);
+    if(dir == NULL) {
+        return -1;
+    }
+    
+    size_t         capacity = 16;
+    size_t         count    = 0;
+    sort_record_t* records  = malloc(sizeof(sort_record_t) * capacity);
+    
+    struct dirent* entry;
+    errno = 0;
+    while((entry = readdir(dir)) != NULL) {
+        if(filter(entry) == 0) {
+            continue;
+        }
+        
+        //  The following if block doubles the memory capacity for the records array when
+        //  the array is full.
+        //
+        //  The resizing is done in this way to keep the cost of insertion to O(1) since the
+        //  size is not known ahead of time. By doubling the size, each resizing operation,
+        //  the number of resizes required tends to 0 as more and more elements are inserted
+        //  since the size of the array grows exponentially while the number of elements
+        //  being inserted grows linearly (i.e. amortization).
+        //
+        if(count >= capacity) {
+            capacity *= 2;
+            records = realloc(records, sizeof(sort_record_t) * capacity);
+        }
+        
+        records[count].dirent = copy_dirent(entry);
+        records[count].key = (sort_key_function != NULL) ? sort_key_function(dir_infos, dir_fd, entry) : 0;
+        count++;
+        
+        errno = 0;
+    }
+    
+    // A NULL return from readdir() with errno set indicates a read error
+    if(errno != 0) {
+        int read_errno = errno;
+        
+        for(size_t i=0; i < count; i++) {
+            free(records[i].dirent);
+        }
+        free(records);
+        closedir(dir);
+        
+        errno = read_errno;
+        return -1;
+    }
+    
+    closedir(dir);
+    
+    if(sort_key_function != NULL) {
+        qsort(records, count, sizeof(sort_record_t), compare_sort_records);
+    }
+    
+    *namelist = malloc(sizeof(struct dirent*) * (count > 0 ? count : 1));
+    for(size_t i=0; i < count; i++) {
+        (*namelist)[i] = records[i].dirent;
+    }
+    free(records);
+    
+    return (int)count;
+}
+
+/* -------- END DIRECTORY SORTING FUNCTIONS -------- */
+
+
+
+
+// Computes md5 checksum of the contents of the open file 'fd', see libgls.h. The file is
+// read in chunks of at least HASH_READ_SIZE bytes since reading one filesystem block at
+// a time is dominated by system call overhead
+//
+int gls_fdcompute_md5(int fd, blksize_t blk_size, unsigned char* md5_bytes) {
+    // Setup md5 context
+    MD5_CTX md5_ctx;
+    if(MD5_Init(&md5_ctx) == 0) {   // Check for initialization error
+        return -1;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    // Let the kernel read ahead more aggressively, this is only a hint so errors are ignored
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    
+    // Round the read size up to a multiple of the block size
+    size_t read_size = (blk_size > 0) ? blk_size : 4096;
+    read_size = ((HASH_READ_SIZE + read_size - 1) / read_size) * read_size;
+    
+    unsigned char* buffer = malloc(read_size);
+    if(buffer == NULL) {
+        return -1;
+    }
+    
+    // Read bytes from the file until either EOF is reached or an error occurs
+    ssize_t bytes_read;
+    while((bytes_read = read(fd, buffer, read_size)) != 0) {
+        if(bytes_read < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            
+            // If a read error occured return -1 to indicate error
+            free(buffer);
+            return -1;
+        }
+        
+        MD5_Update(&md5_ctx, buffer, (unsigned int)bytes_read);
+    }
+    
+    free(buffer);
+    
+    // Put md5 hash into 'md5_bytes'
+    if(MD5_Final(md5_bytes, &md5_ctx) == 0) {
+        // If an error occured return -1 to indicate error
+        return -1;
+    }
+    
+    return 0;   // return success
+}
+
+
+// Computes md5 checksum of file contents of the file 'name' in the directory 'dir_fd'
+// and places the raw checksum bytes into the buffer pointed to by 'md5_bytes'
+//
+// parameters:
+//      dir_fd    - file descriptor of the directory containing the file
+//      name      - the name of the file used to calculate the md5 checksum
+//      blk_size  - blocksize for efficient filesystem I/O, can be obtained from stat struct field 'st_blksize'
+//      md5_bytes - pointer to a buffer of at least MD5_DIGEST_LENGTH bytes to hold the checksum
+//
+// returns: int
+//      0 if the md5 checksum was computed successfully, otherwise -1 will be returned
+//      with errno set as described for gls_fdcompute_md5()
+//
+static int fcompute_md5_at(int dir_fd, const char* name, blksize_t blk_size, unsigned char* md5_bytes) {
+    // Open file for binary read
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    
+    // Check if file opened successfully, if not return -1 to indicate an error
+    if(fd < 0) {
+        return -1;
+    }
+    
+    int result = gls_fdcompute_md5(fd, blk_size, md5_bytes);
+    
+    // Preserve errno of a read error across close()
+    int read_errno = errno;
+    close(fd);
+    errno = read_errno;
+    
+    return result;
+}
+
+
+// Converts the raw md5 checksum 'md5_bytes' into a string of hexadecimal characters,
+// see libgls.h
+//
+void gls_md5_to_strn(const unsigned char* md5_bytes, char* md5_str, unsigned int n) {
+    // Convert md5 hash into hex string and place into 'md5_str'
+    static const char* hex_table = "0123456789abcdef";
+    
+    int i;
+    for(i=0; i < MD5_DIGEST_LENGTH && i*2 < n-2; i++) {
+        // 'hex_table' is used to convert nibbles to hex chars
+        // string is written in big-endian so the MSB is written
+        // first and he LSB last, as an example the binary string
+        // 1001 1010 0001 1111 becomes 9A1F
+        (*md5_str++) = hex_table[(md5_bytes[i]>>4) & 0xF];
+        (*md5_str++) = hex_table[ md5_bytes[i]     & 0xF];
+    }
+    
+    // If the string was truncated check to see if one more hex digit
+    // could fit
+    if(i < MD5_DIGEST_LENGTH && i*2 < n-1) {
+        (*md5_str++) = hex_table[(md5_bytes[i]>>4) & 0xF];
+    }
+    
+    *md5_str = '\0';    // Append null terminator
+}
+
+
+
+
+/* -------- FILE HASH CACHE FUNCTIONS -------- */
+
+// The hash cache maps a file (device and inode number) to the md5 checksum of its
+// contents. It is used so that files hashed by compute_dir_size() for the directory
+// digests are not hashed a second time by parse_directory(), and when a cache file
+// is given so that unchanged files are not hashed again on later scans. Since it is
+// keyed by inode, a cache shared by several scans also hashes files hard linked into
+// more than one of their trees only once. The table uses open addressing with linear
+// probing.
+
+
+// File hash cache, owned by a single scan or created with gls_cache_create() and shared
+// by scans running at the same time
+struct gls_cache {
+    hash_cache_entry_t* entries;
+    size_t              capacity;   // Always a power of 2
+    size_t              count;
+    int                 hard_links_only;    // Nonzero to only keep files with more than one link
+    pthread_mutex_t     mutex;              // Guards the table, held while it is read or changed
+    pthread_cond_t      hashed;             // Broadcast when a file being hashed is done
+};
+
+
+// Computes the hash table position of a file from its device and inode number, before
+// reducing it to the capacity of the table
+//
+// parameters:
+//      dev - device id of the file
+//      ino - inode number of the file
+//
+// returns: size_t
+//      the hash of the file
+//
+static size_t inode_hash(dev_t dev, ino_t ino) {
+    uint64_t hash = ((uint64_t)ino ^ ((uint64_t)dev << 32)) * 0x9E3779B97F4A7C15ULL;
+    
+    return (size_t)(hash >> 32);
+}
+
+
+// Finds the slot for the file with the given device and inode number, the mutex of the
+// cache must be held
+//
+// parameters:
+//      cache - the hash cache
+//      dev   - device id of the file
+//      ino   - inode number of the file
+//
+// returns: hash_cache_entry_t*
+//      pointer to the slot holding the file, or to the empty slot where it should be inserted
+//
+static hash_cache_entry_t* hash_cache_slot(gls_cache_t* cache, dev_t dev, ino_t ino) {
+    size_t mask = cache->capacity - 1;
+    
+    for(size_t i = inode_hash(dev, ino) & mask; ; i = (i + 1) & mask) {
+        hash_cache_entry_t* slot = &cache->entries[i];
+        
+        if(slot->state == 0 || (slot->dev == dev && slot->ino == ino)) {
+            return slot;
+        }
+    }
+}
+
+
+// Inserts or replaces the md5 checksum of a file in the hash cache, the mutex of the
+// cache must be held
+//
+// parameters:
+//      cache     - the hash cache
+//      info      - stat information of the file the checksum was computed for
+//      md5_bytes - the MD5_DIGEST_LENGTH bytes of the checksum
+//      state     - 1 if the entry was loaded from the cache file, 2 if it was computed this run
+//
+// returns: void
+//
+static void hash_cache_insert(gls_cache_t* cache, const struct stat* info, const unsigned char* md5_bytes, int state) {
+    // Double the capacity once the table is half full to keep probe sequences short,
+    // every entry has to be reinserted since slot positions depend on the capacity
+    if((cache->count + 1) * 2 > cache->capacity) {
+        hash_cache_entry_t* old_entries  = cache->entries;
+        size_t              old_capacity = cache->capacity;
+        
+        cache->capacity *= 2;
+        cache->entries = calloc(cache->capacity, sizeof(hash_cache_entry_t));
+        
+        for(size_t i=0; i < old_capacity; i++) {
+            if(old_entries[i].state != 0) {
+                *hash_cache_slot(cache, old_entries[i].dev, old_entries[i].ino) = old_entries[i];
+            }
+        }
+        
+        free(old_entries);
+    }
+    
+    hash_cache_entry_t* slot = hash_cache_slot(cache, info->st_dev, info->st_ino);
+    if(slot->state == 0) {
+        cache->count++;
+    }
+    
+    slot->dev   = info->st_dev;
+    slot->ino   = info->st_ino;
+    slot->size  = info->st_size;
+    slot->mtime = STAT_MTIM(*info);
+    slot->ctime = STAT_CTIM(*info);
+    slot->state = state;
+    memcpy(slot->md5, md5_bytes, MD5_DIGEST_LENGTH);
+}
+
+
+// Computes the md5 checksum of a regular file, reusing the checksum stored in the hash
+// cache if the file has not changed since. If the scan has no hash cache, or the cache
+// only keeps hard linked files and the file has a single link, the checksum is always
+// computed. While a file is hashed its slot is marked so that scans sharing the cache
+// which reach the same file (i.e. through a hard link) wait for the checksum instead
+// of hashing it again, the mutex is not held while hashing
+//
+// parameters:
+//      scan      - the scan using the hash cache
+//      dir_fd    - file descriptor of the directory containing the file
+//      name      - the name of the file used to calculate the md5 checksum
+//      info      - stat information of the file
+//      md5_bytes - pointer to a buffer of at least MD5_DIGEST_LENGTH bytes to hold the checksum
+//
+// returns: int
+//      0 if the md5 checksum was computed successfully, otherwise -1 will be returned
+//      with errno set as described for gls_fdcompute_md5()
+//
+static int fcompute_md5_cached(gls_scan_t* scan, int dir_fd, const char* name, const struct stat* info, unsigned char* md5_bytes) {
+    static const unsigned char no_md5[MD5_DIGEST_LENGTH];
+    
+    gls_cache_t* cache = scan->hash_cache;
+    if(cache == NULL || (cache->hard_links_only && info->st_nlink < 2)) {
+        return fcompute_md5_at(dir_fd, name, info->st_blksize, md5_bytes);
+    }
+    
+    pthread_mutex_lock(&cache->mutex);
+    
+    hash_cache_entry_t* slot;
+    while((slot = hash_cache_slot(cache, info->st_dev, info->st_ino))->state == 3) {
+        pthread_cond_wait(&cache->hashed, &cache->mutex);
+    }
+    
+    if(slot->state != 0 && slot->size == info->st_size &&
+       slot->mtime.tv_sec == STAT_MTIM(*info).tv_sec && slot->mtime.tv_nsec == STAT_MTIM(*info).tv_nsec &&
+       slot->ctime.tv_sec == STAT_CTIM(*info).tv_sec && slot->ctime.tv_nsec == STAT_CTIM(*info).tv_nsec) {
+        
+        slot->state = 2;
+        memcpy(md5_bytes, slot->md5, MD5_DIGEST_LENGTH);
+        
+        pthread_mutex_unlock(&cache->mutex);
+        return 0;
+    }
+    
+    hash_cache_insert(cache, info, no_md5, 3);
+    
+    pthread_mutex_unlock(&cache->mutex);
+    
+    int result       = fcompute_md5_at(dir_fd, name, info->st_blksize, md5_bytes);
+    int result_errno = errno;
+    
+    // The slot is looked up again since the table may have grown while hashing
+    pthread_mutex_lock(&cache->mutex);
+    
+    slot = hash_cache_slot(cache, info->st_dev, info->st_ino);
+    if(result == 0) {
+        memcpy(slot->md5, md5_bytes, MD5_DIGEST_LENGTH);
+        slot->state = 2;
+    } else {
+        // Leave an entry which matches no file and is not saved, waiting scans hash the file themselves
+        slot->size  = -1;
+        slot->state = 1;
+    }
+    
+    pthread_cond_broadcast(&cache->hashed);
+    pthread_mutex_unlock(&cache->mutex);
+    
+    errno = result_errno;
+    return result;
+}
+
+
+// Loads the hash cache from the file at 'path', one entry per line in the format
+// written by gls_cache_save(). A cache file which cannot be read is ignored since
+// the cache only avoids work, if it cannot be written either saving it will fail
+//
+// parameters:
+//      cache - the hash cache, not yet shared with any scan
+//      path  - path of the cache file
+//
+// returns: void
+//
+static void hash_cache_load(gls_cache_t* cache, const char* path) {
+    FILE* fp = fopen(path, "r");
+    if(fp == NULL) {
+        return;
+    }
+    
+    unsigned long long dev, ino;
+    long long size, mtime_sec, ctime_sec;
+    long mtime_nsec, ctime_nsec;
+    char md5_str[MD5_DIGEST_LENGTH*2 + 1];
+    
+    while(fscanf(fp, "%llu %llu %lld %lld %ld %lld %ld %32s", &dev, &ino, &size, &mtime_sec, &mtime_nsec,
+                 &ctime_sec, &ctime_nsec, md5_str) == 8) {
+        
+        // Convert the hex string back into the raw checksum, skipping malformed entries
+        unsigned char md5_bytes[MD5_DIGEST_LENGTH];
+        int i;
+        for(i=0; i < MD5_DIGEST_LENGTH; i++) {
+            unsigned int byte;
+            if(sscanf(md5_str + i*2, "%2x", &byte) != 1) {
+                break;
+            }
+            md5_bytes[i] = (unsigned char)byte;
+        }
+        if(i < MD5_DIGEST_LENGTH) {
+            continue;
+        }
+        
+        struct stat info;
+        memset(&info, 0, sizeof(info));
+        info.st_dev  = (dev_t)dev;
+        info.st_ino  = (ino_t)ino;
+        info.st_size = (off_t)size;
+        STAT_MTIM(info).tv_sec  = (time_t)mtime_sec;
+        STAT_MTIM(info).tv_nsec = mtime_nsec;
+        STAT_CTIM(info).tv_sec  = (time_t)ctime_sec;
+        STAT_CTIM(info).tv_nsec = ctime_nsec;
+        
+        hash_cache_insert(cache, &info, md5_bytes, 1);
+    }
+    
+    fclose(fp);
+}
+
+
+// Creates an empty hash cache and loads it from a cache file, see libgls.h
+//
+gls_cache_t* gls_cache_create(const char* path, int hard_links_only) {
+    gls_cache_t* cache = calloc(1, sizeof(gls_cache_t));
+    if(cache == NULL) {
+        return NULL;
+    }
+    
+    cache->capacity        = 1024;
+    cache->count           = 0;
+    cache->hard_links_only = hard_links_only;
+    cache->entries         = calloc(cache->capacity, sizeof(hash_cache_entry_t));
+    if(cache->entries == NULL) {
+        free(cache);
+        return NULL;
+    }
+    
+    pthread_mutex_init(&cache->mutex, NULL);
+    pthread_cond_init(&cache->hashed, NULL);
+    
+    if(path != NULL) {
+        hash_cache_load(cache, path);
+    }
+    
+    return cache;
+}
+
+
+// Saves the entries of the hash cache that were used by scans to a cache file, see libgls.h.
+// The entries are written to a temporary file next to the cache file which then replaces
+// it, so a failed or interrupted save (or another run saving at the same time) never
+// leaves a partially written cache file behind. mkstemp() creates the temporary file
+// readable by its owner only, so it is given the mode of the cache file it replaces,
+// or the mode a new file would get from the umask
+//
+int gls_cache_save(gls_cache_t* cache, const char* path) {
+    char tmp_path[strlen(path) + sizeof(".XXXXXX")];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+    
+    mode_t      mode;
+    struct stat old_info;
+    if(stat(path, &old_info) == 0) {
+        mode = old_info.st_mode & 07777;
+    } else {
+        // The umask can only be read by setting it, it is restored right away and a file
+        // created by another thread in between is at worst private to its owner
+        mode_t mask = umask(077);
+        umask(mask);
+        mode = 0666 & ~mask;
+    }
+    
+    int fd = mkstemp(tmp_path);
+    if(fd < 0) {
+        return -1;
+    }
+    
+    FILE* fp = (fchmod(fd, mode) == 0) ? fdopen(fd, "w") : NULL;
+    if(fp == NULL) {
+        int saved_errno = errno;
+        close(fd);
+        unlink(tmp_path);
+        errno = saved_errno;
+        return -1;
+    }
+    
+    pthread_mutex_lock(&cache->mutex);
+    
+    for(size_t i=0; i < cache->capacity; i++) {
+        hash_cache_entry_t* entry = &cache->entries[i];
+        if(entry->state != 2) {
+            continue;
+        }
+        
+        char md5_str[MD5_DIGEST_LENGTH*2 + 1];
+        gls_md5_to_strn(entry->md5, md5_str, sizeof(md5_str));
+        
+        fprintf(fp, "%llu %llu %lld %lld %ld %lld %ld %s\n", (unsigned long long)entry->dev, (unsigned long long)entry->ino,
+                (long long)entry->size, (long long)entry->mtime.tv_sec, (long)entry->mtime.tv_nsec,
+                (long long)entry->ctime.tv_sec, (long)entry->ctime.tv_nsec, md5_str);
+    }
+    
+    pthread_mutex_unlock(&cache->mutex);
+    
+    // fclose() reports errors of the buffered writes, ferror() those of earlier flushes
+    int write_failed = ferror(fp);
+    if(fclose(fp) != 0 || write_failed || rename(tmp_path, path) != 0) {
+        int saved_errno = (errno != 0) ? errno : EIO;
+        unlink(tmp_path);
+        errno = saved_errno;
+        return -1;
+    }
+    
+    return 0;
+}
+
+
+// Frees a hash cache, see libgls.h
+//
+void gls_cache_free(gls_cache_t* cache) {
+    if(cache == NULL) {
+        return;
+    }
+    
+    pthread_cond_destroy(&cache->hashed);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache->entries);
+    free(cache);
+}
+
+/* -------- END FILE HASH CACHE FUNCTIONS -------- */
+
+
+
+
+/* -------- HASHING POOL FUNCTIONS -------- */
+
+// The regular files of a directory are stat'ed and hashed through a hash batch. When
+// the scan has a pool, each batch queues the files a few entries ahead of the one the
+// scan is at, and the threads of the pool (shared by every scan using it) hash them in
+// the order they were queued, so the scans share the threads roughly equally. The scan
+// still visits the entries in order: it waits for a file only if a pool thread is
+// hashing it, and in the meantime hashes the files it queued itself rather than idle.
+// The batch keeps its jobs in a ring just large enough for the entries queued ahead.
+// Entries which are not sorted are read from the directory stream as the scan and the
+// queueing reach them rather than all up front, and are kept in a ring the same way.
+
+
+// State of a hash job
+typedef enum {
+    HASH_JOB_EMPTY,         // Slot of the ring not used yet
+    HASH_JOB_PENDING,       // Stat'ed and waiting to be hashed, not queued
+    HASH_JOB_QUEUED,        // In the queue of the pool
+    HASH_JOB_RUNNING,       // Being hashed by a thread
+    HASH_JOB_DONE           // The stat and hash results are final
+} hash_job_state_t;
+
+
+struct hash_batch;
+
+
+// Regular file of a directory to be stat'ed and hashed
+typedef struct hash_job {
+    struct hash_batch* batch;               // Batch the job belongs to
+    int                index;               // Index of the entry in the directory
+    const char*        name;
+    struct stat        info;
+    int                stat_error;          // errno of fstatat(), 0 if the file was stat'ed
+    int                hash_result;         // Result of fcompute_md5_cached(), -1 if not hashed
+    int                hash_error;          // errno of fcompute_md5_cached()
+    unsigned char      md5[MD5_DIGEST_LENGTH];
+    hash_job_state_t   state;
+    struct hash_job*   prev;                // Neighbours in the queue of the pool while queued
+    struct hash_job*   next;
+} hash_job_t;
+
+
+// Entries of one directory, the regular files of which are stat'ed and hashed for a scan
+typedef struct hash_batch {
+    gls_scan_t*      scan;
+    gls_pool_t*      pool;                  // NULL to hash every file on the scanning thread
+    int              dir_fd;
+    DIR*             stream;                // Stream the entries are read from as needed, NULL once the
+                                            // end was reached or if 'entries' holds every entry
+    int              streamed;              // Nonzero if the entries are read from a stream
+    int              read_error;            // errno of the failed read of the stream, 0 if none
+    struct dirent**  entries;               // Every entry, or a ring of 'window' + 1 entries read from the
+                                            // stream (entry i in entries[i % (window + 1)]) owned by the batch
+    int              num_entries;           // Number of entries, or of entries read so far from a stream
+    int              hash;                  // Nonzero to hash the files, otherwise they are only stat'ed
+    int              window;                // Number of entries queued ahead of the current one
+    hash_job_t*      jobs;                  // Ring of 'window' + 1 jobs, entry i uses jobs[i % (window + 1)]
+    int              next_ahead;            // Index of the next entry to be considered for queueing
+} hash_batch_t;
+
+
+// Threads hashing the files queued by the scans sharing the pool
+struct gls_pool {
+    pthread_t*      threads;
+    int             num_threads;
+    int             num_lent;               // Threads of the caller running gls_pool_work()
+    int             shutdown;               // Set once no more files will be queued
+    hash_job_t*     queue_head;
+    hash_job_t*     queue_tail;
+    pthread_mutex_t mutex;                  // Guards the queue and the states of queued jobs
+    pthread_cond_t  job_queued;             // Signalled when a job is queued or the pool shuts down
+    pthread_cond_t  job_done;               // Broadcast when a pool thread finishes a job or returns
+};
+
+
+// Appends a job to the queue of the pool, the mutex of the pool must be held
+//
+// parameters:
+//      pool - the pool
+//      job  - the job to be queued
+//
+// returns: void
+//
+static void pool_append(gls_pool_t* pool, hash_job_t* job) {
+    job->prev  = pool->queue_tail;
+    job->next  = NULL;
+    job->state = HASH_JOB_QUEUED;
+    
+    if(pool->queue_tail != NULL) {
+        pool->queue_tail->next = job;
+    } else {
+        pool->queue_head = job;
+    }
+    pool->queue_tail = job;
+}
+
+
+// Removes a queued job from the queue of the pool, the mutex of the pool must be held
+//
+// parameters:
+//      pool - the pool
+//      job  - the queued job
+//
+// returns: void
+//
+static void pool_unlink(gls_pool_t* pool, hash_job_t* job) {
+    if(job->prev != NULL) {
+        job->prev->next = job->next;
+    } else {
+        pool->queue_head = job->next;
+    }
+    
+    if(job->next != NULL) {
+        job->next->prev = job->prev;
+    } else {
+        pool->queue_tail = job->prev;
+    }
+}
+
+
+// Hashes the file of a job, the job must be in the running state so no other thread
+// touches it
+//
+// parameters:
+//      job - the job to be run
+//
+// returns: void
+//
+static void hash_job_run(hash_job_t* job) {
+    errno = 0;
+    job->hash_result = fcompute_md5_cached(job->batch->scan, job->batch->dir_fd, job->name, &job->info, job->md5);
+    job->hash_error  = errno;
+}
+
+
+// Runs queued jobs until the queue is empty after the pool was shut down, the mutex
+// of the pool must be held and is held again on return
+//
+// parameters:
+//      pool - the pool
+//
+// returns: void
+//
+static void pool_work(gls_pool_t* pool) {
+    for(;;) {
+        while(pool->queue_head == NULL && !pool->shutdown) {
+            pthread_cond_wait(&pool->job_queued, &pool->mutex);
+        }
+        
+        hash_job_t* job = pool->queue_head;
+        if(job == NULL) {
+            return;
+        }
+        
+        pool_unlink(pool, job);
+        job->state = HASH_JOB_RUNNING;
+        pthread_mutex_unlock(&pool->mutex);
+        
+        hash_job_run(job);
+        
+        pthread_mutex_lock(&pool->mutex);
+        job->state = HASH_JOB_DONE;
+        pthread_cond_broadcast(&pool->job_done);
+    }
+}
+
+
+// Thread function of the threads created by gls_pool_create()
+//
+// parameters:
+//      arg - the pool
+//
+// returns: void*
+//      always NULL
+//
+static void* pool_thread(void* arg) {
+    gls_pool_t* pool = arg;
+    
+    pthread_mutex_lock(&pool->mutex);
+    pool_work(pool);
+    pthread_mutex_unlock(&pool->mutex);
+    
+    return NULL;
+}
+
+
+// Creates a pool of threads hashing files for scans, see libgls.h
+//
+gls_pool_t* gls_pool_create(int num_threads) {
+    gls_pool_t* pool = calloc(1, sizeof(gls_pool_t));
+    if(pool == NULL) {
+        return NULL;
+    }
+    
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->job_queued, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+    
+    pool->threads = malloc(sizeof(pthread_t) * (num_threads > 0 ? num_threads : 1));
+    
+    for(int i=0; i < num_threads; i++) {
+        if(pthread_create(&pool->threads[pool->num_threads], NULL, pool_thread, pool) == 0) {
+            pool->num_threads++;
+        }
+    }
+    
+    return pool;
+}
+
+
+// Lends the calling thread to the pool until it is shut down, see libgls.h
+//
+void gls_pool_work(gls_pool_t* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    
+    if(!pool->shutdown) {
+        pool->num_lent++;
+        pool_work(pool);
+        pool->num_lent--;
+        pthread_cond_broadcast(&pool->job_done);
+    }
+    
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+// Shuts down a pool, see libgls.h
+//
+void gls_pool_shutdown(gls_pool_t* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->job_queued);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+// Shuts down and frees a pool, see libgls.h
+//
+void gls_pool_free(gls_pool_t* pool) {
+    if(pool == NULL) {
+        return;
+    }
+    
+    gls_pool_shutdown(pool);
+    
+    for(int i=0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->num_lent > 0) {
+        pthread_cond_wait(&pool->job_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    
+    pthread_cond_destroy(&pool->job_done);
+    pthread_cond_destroy(&pool->job_queued);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->threads);
+    free(pool);
+}
+
+
+// Returns an entry of the directory which was already read, for a stream the entry must
+// be one of the last 'window' + 1 read
+//
+// parameters:
+//      batch - the batch of the directory
+//      index - index of the entry in the directory
+//
+// returns: struct dirent*
+//      the entry
+//
+static struct dirent* hash_batch_dirent(hash_batch_t* batch, int index) {
+    return batch->streamed ? batch->entries[index % (batch->window + 1)] : batch->entries[index];
+}
+
+
+// Reads entries from the stream of the directory until entry 'index' was read or the end
+// of the directory was reached, replacing the oldest entries in the ring
+//
+// parameters:
+//      batch - the batch of the directory
+//      index - index of the entry to read up to
+//
+// returns: void
+//
+static void hash_batch_read(hash_batch_t* batch, int index) {
+    while(batch->stream != NULL && batch->num_entries <= index) {
+        errno = 0;
+        struct dirent* entry = readdir(batch->stream);
+        
+        // A NULL return from readdir() with errno set indicates a read error
+        if(entry == NULL) {
+            batch->read_error = errno;
+            closedir(batch->stream);
+            batch->stream = NULL;
+            break;
+        }
+        
+        if(batch->scan->filter_function(entry) == 0) {
+            continue;
+        }
+        
+        struct dirent** slot = &batch->entries[batch->num_entries % (batch->window + 1)];
+        free(*slot);
+        *slot = copy_dirent(entry);
+        batch->num_entries++;
+    }
+}
+
+
+// Returns an entry of the directory, reading it from the stream if needed. Entries must
+// be requested in increasing order of their index
+//
+// parameters:
+//      batch - the batch of the directory
+//      index - index of the entry in the directory
+//
+// returns: struct dirent*
+//      the entry, NULL past the last entry or if the stream could not be read (see 'read_error')
+//
+static struct dirent* hash_batch_entry(hash_batch_t* batch, int index) {
+    hash_batch_read(batch, index);
+    
+    return (index < batch->num_entries) ? hash_batch_dirent(batch, index) : NULL;
+}
+
+
+// Prepares the job of a regular file by stat'ing it, following symbolic links
+//
+// parameters:
+//      batch - the batch of the directory
+//      index - index of the regular file in the directory
+//
+// returns: void
+//
+static void hash_batch_prepare(hash_batch_t* batch, int index) {
+    hash_job_t* job = &batch->jobs[index % (batch->window + 1)];
+    
+    job->batch       = batch;
+    job->index       = index;
+    job->name        = hash_batch_dirent(batch, index)->d_name;
+    job->hash_result = -1;
+    job->hash_error  = 0;
+    
+    if(fstatat(batch->dir_fd, job->name, &job->info, 0) < 0) {
+        job->stat_error = errno;
+        job->state      = HASH_JOB_DONE;
+    } else {
+        job->stat_error = 0;
+        job->state      = batch->hash ? HASH_JOB_PENDING : HASH_JOB_DONE;
+    }
+}
+
+
+// Initializes the batch of a directory, must be freed with hash_batch_free() before
+// the entries are freed or the directory is closed
+//
+// parameters:
+//      batch       - the batch to initialize
+//      scan        - the scan the directory is read for
+//      dir_fd      - file descriptor of the directory
+//      entries     - the entries of the directory, ignored if 'stream' is given
+//      num_entries - the number of entries in 'entries'
+//      stream      - stream to read the entries from as they are needed (filtered with the
+//                    filter function of the scan), NULL to use 'entries'. The batch takes
+//                    ownership of the stream
+//      hash        - nonzero to hash the regular files, 0 to only stat them
+//
+// returns: void
+//
+static void hash_batch_init(hash_batch_t* batch, gls_scan_t* scan, int dir_fd, struct dirent** entries, int num_entries, DIR* stream, int hash) {
+    batch->scan        = scan;
+    batch->pool        = hash ? scan->options->pool : NULL;
+    batch->dir_fd      = dir_fd;
+    batch->stream      = stream;
+    batch->streamed    = (stream != NULL);
+    batch->read_error  = 0;
+    batch->entries     = entries;
+    batch->num_entries = batch->streamed ? 0 : num_entries;
+    batch->hash        = hash;
+    batch->window      = 0;
+    batch->next_ahead  = 0;
+    
+    // Queue a couple of files per thread ahead so no thread of the pool runs out of work
+    if(batch->pool != NULL) {
+        pthread_mutex_lock(&batch->pool->mutex);
+        batch->window = 2 * (batch->pool->num_threads + batch->pool->num_lent);
+        pthread_mutex_unlock(&batch->pool->mutex);
+        
+        if(batch->window == 0) {
+            batch->pool = NULL;
+        }
+    }
+    
+    batch->jobs = calloc(batch->window + 1, sizeof(hash_job_t));
+    
+    if(batch->streamed) {
+        batch->entries = calloc(batch->window + 1, sizeof(struct dirent*));
+    }
+}
+
+
+// Queues the regular files from entry 'from' up to the end of the window ahead of it
+// which have not been queued yet
+//
+// parameters:
+//      batch - the batch of the directory
+//      from  - index of the first entry after the current one
+//
+// returns: void
+//
+static void hash_batch_queue_ahead(hash_batch_t* batch, int from) {
+    if(batch->pool == NULL) {
+        return;
+    }
+    
+    hash_batch_read(batch, from + batch->window - 1);
+    
+    int start = (batch->next_ahead > from) ? batch->next_ahead : from;
+    int end   = (from + batch->window < batch->num_entries) ? from + batch->window : batch->num_entries;
+    
+    if(start >= end) {
+        return;
+    }
+    
+    // The files are stat'ed before taking the mutex of the pool
+    for(int i=start; i < end; i++) {
+        if(hash_batch_dirent(batch, i)->d_type == DT_REG) {
+            hash_batch_prepare(batch, i);
+        }
+    }
+    
+    pthread_mutex_lock(&batch->pool->mutex);
+    
+    for(int i=start; i < end; i++) {
+        hash_job_t* job = &batch->jobs[i % (batch->window + 1)];
+        
+        if(hash_batch_dirent(batch, i)->d_type == DT_REG && job->state == HASH_JOB_PENDING) {
+            pool_append(batch->pool, job);
+        }
+    }
+    
+    pthread_cond_broadcast(&batch->pool->job_queued);
+    pthread_mutex_unlock(&batch->pool->mutex);
+    
+    batch->next_ahead = end;
+}
+
+
+// Returns the stat and hash results of a regular file, entries must be passed in
+// increasing order of their index
+//
+// parameters:
+//      batch - the batch of the directory
+//      index - index of the regular file in the directory
+//
+// returns: const hash_job_t*
+//      the finished job of the file, valid until the next call
+//
+static const hash_job_t* hash_batch_get(hash_batch_t* batch, int index) {
+    hash_job_t* job = &batch->jobs[index % (batch->window + 1)];
+    
+    if(batch->next_ahead <= index) {
+        hash_batch_prepare(batch, index);
+    }
+    
+    hash_batch_queue_ahead(batch, index + 1);
+    
+    if(batch->pool == NULL) {
+        if(job->state == HASH_JOB_PENDING) {
+            hash_job_run(job);
+            job->state = HASH_JOB_DONE;
+        }
+        
+        return job;
+    }
+    
+    gls_pool_t* pool = batch->pool;
+    pthread_mutex_lock(&pool->mutex);
+    
+    while(job->state != HASH_JOB_DONE) {
+        hash_job_t* claimed = NULL;
+        
+        if(job->state != HASH_JOB_RUNNING) {
+            claimed = job;
+        } else {
+            // The file is being hashed by a pool thread, hash a file queued ahead meanwhile
+            for(int i=index + 1; i < batch->next_ahead && claimed == NULL; i++) {
+                hash_job_t* ahead = &batch->jobs[i % (batch->window + 1)];
+                
+                if(ahead->index == i && ahead->state == HASH_JOB_QUEUED) {
+                    claimed = ahead;
+                }
+            }
+        }
+        
+        if(claimed == NULL) {
+            pthread_cond_wait(&pool->job_done, &pool->mutex);
+            continue;
+        }
+        
+        if(claimed->state == HASH_JOB_QUEUED) {
+            pool_unlink(pool, claimed);
+        }
+        claimed->state = HASH_JOB_RUNNING;
+        pthread_mutex_unlock(&pool->mutex);
+        
+        hash_job_run(claimed);
+        
+        pthread_mutex_lock(&pool->mutex);
+        claimed->state = HASH_JOB_DONE;
+    }
+    
+    pthread_mutex_unlock(&pool->mutex);
+    
+    return job;
+}
+
+
+// Frees a batch, removing the files still queued from the pool and waiting for the
+// files being hashed by pool threads. Entries read from a stream are freed along with
+// the stream
+//
+// parameters:
+//      batch - the batch to free
+//
+// returns: void
+//
+static void hash_batch_free(hash_batch_t* batch) {
+    if(batch->pool != NULL) {
+        pthread_mutex_lock(&batch->pool->mutex);
+        
+        for(;;) {
+            int running = 0;
+            
+            for(int i=0; i <= batch->window; i++) {
+                hash_job_t* job = &batch->jobs[i];
+                
+                if(job->state == HASH_JOB_QUEUED) {
+                    pool_unlink(batch->pool, job);
+                    job->state = HASH_JOB_DONE;
+                } else if(job->state == HASH_JOB_RUNNING) {
+                    running = 1;
+                }
+            }
+            
+            if(!running) {
+                break;
+            }
+            
+            pthread_cond_wait(&batch->pool->job_done, &batch->pool->mutex);
+        }
+        
+        pthread_mutex_unlock(&batch->pool->mutex);
+    }
+    
+    free(batch->jobs);
+    
+    if(batch->streamed) {
+        for(int i=0; i <= batch->window; i++) {
+            free(batch->entries[i]);
+        }
+        free(batch->entries);
+        
+        if(batch->stream != NULL) {
+            closedir(batch->stream);
+        }
+    }
+}
+
+/* -------- END HASHING POOL FUNCTIONS -------- */
+
+
+
+
+// Directory entry together with the digest of its contents, used to compute directory digests
+typedef struct {
+    const struct dirent* dirent;
+    const unsigned char* digest;
+} digest_record_t;
+
+
+// Comparison function for qsort(), orders digest records by name in byte order
+//
+// parameters:
+//      a - pointer to the first digest record
+//      b - pointer to the second digest record
+//
+// returns: int
+//      negative if 'a' is ordered before 'b', positive if 'a' is ordered after 'b', 0 if equal
+//
+static int compare_digest_records(const void* a, const void* b) {
+    return strcmp( ((const digest_record_t*)a)->dirent->d_name, ((const digest_record_t*)b)->dirent->d_name );
+}
+
+
+// Computes the merkle digest of a directory from its entries. Each entry is identified
+// by its name and type followed by the digest of its contents, this way renaming,
+// replacing or modifying any entry in a subtree changes the digest of every directory
+// above it. The entries are fed in byte order of their names so the digest does not
+// depend on the order the directory was scanned in
+//
+// parameters:
+//      entries     - the entries of the directory
+//      num_entries - the number of entries in 'entries'
+//      digests     - MD5_DIGEST_LENGTH bytes describing the contents of each entry, stored
+//                    directly after each other in the same order as 'entries'
+//      dir_digest  - pointer to a buffer of MD5_DIGEST_LENGTH bytes to hold the directory digest
+//
+// returns: void
+//
+static void digest_directory(struct dirent** entries, int num_entries, const unsigned char* digests, unsigned char* dir_digest) {
+    digest_record_t* records = malloc(sizeof(digest_record_t) * (num_entries > 0 ? num_entries : 1));
+    for(int i=0; i < num_entries; i++) {
+        records[i].dirent = entries[i];
+        records[i].digest = digests + i * MD5_DIGEST_LENGTH;
+    }
+    
+    qsort(records, num_entries, sizeof(digest_record_t), compare_digest_records);
+    
+    MD5_CTX dir_ctx;
+    MD5_Init(&dir_ctx);
+    
+    for(int i=0; i < num_entries; i++) {
+        const char*   name = records[i].dirent->d_name;
+        unsigned char type = records[i].dirent->d_type;
+        
+        MD5_Update(&dir_ctx, name, (unsigned int)strlen(name) + 1);     // Include null terminator as a separator
+        MD5_Update(&dir_ctx, &type, 1);
+        MD5_Update(&dir_ctx, records[i].digest, MD5_DIGEST_LENGTH);
+    }
+    
+    MD5_Final(dir_digest, &dir_ctx);
+    
+    free(records);
+}
+
+
+// Computes the contents digest of an entry which is neither a directory nor a regular file
+// for digest_directory() (the digest of a regular file is its md5 checksum), for symbolic
+// links this is the md5 checksum of the symlink contents. Other entries have a zero digest,
+// symbolic links which could not be read have an error digest
+//
+// parameters:
+//      dir_fd         - file descriptor of the directory containing the entry
+//      current_dirent - the entry to compute the digest for
+//      digest         - pointer to a buffer of MD5_DIGEST_LENGTH bytes to hold the digest
+//
+// returns: int
+//      0 if the digest was computed, -1 if the entry could not be read
+//
+static int digest_entry_contents(int dir_fd, const struct dirent* current_dirent, unsigned char* digest) {
+    memset(digest, 0, MD5_DIGEST_LENGTH);
+    
+    if(current_dirent->d_type == DT_LNK) {
+        char symlink_name[PATH_MAX];
+        ssize_t symlink_size = readlinkat(dir_fd, current_dirent->d_name, symlink_name, sizeof(symlink_name));
+        
+        if(symlink_size < 0) {
+            memset(digest, DIGEST_ERROR_BYTE, MD5_DIGEST_LENGTH);
+            return -1;
+        }
+        
+        MD5_CTX md5_ctx;
+        MD5_Init(&md5_ctx);
+        MD5_Update(&md5_ctx, symlink_name, (unsigned int)symlink_size);
+        MD5_Final(digest, &md5_ctx);
+    }
+    
+    return 0;
+}
+
+
+// Finds the slot for the directory with the given device and inode number
+//
+// parameters:
+//      table - the directory information table
+//      dev   - device id of the directory
+//      ino   - inode number of the directory
+//
+// returns: dir_info_t*
+//      pointer to the slot holding the directory, or to the empty slot where it should be inserted
+//
+static dir_info_t* dir_info_slot(dir_info_table_t* table, dev_t dev, ino_t ino) {
+    size_t mask = table->capacity - 1;
+    
+    for(size_t i = inode_hash(dev, ino) & mask; ; i = (i + 1) & mask) {
+        dir_info_t* slot = &table->slots[i];
+        
+        if(!slot->used || (slot->dev == dev && slot->ino == ino)) {
+            return slot;
+        }
+    }
+}
+
+
+// Inserts the information of a directory into the table
+//
+// parameters:
+//      table - the directory information table
+//      info  - the information of the directory, including its device and inode number
+//
+// returns: void
+//
+static void dir_info_insert(dir_info_table_t* table, const dir_info_t* info) {
+    // Double the capacity once the table is half full (see hash_cache_insert())
+    if((table->count + 1) * 2 > table->capacity) {
+        dir_info_t* old_slots    = table->slots;
+        size_t      old_capacity = table->capacity;
+        
+        table->capacity *= 2;
+        table->slots = calloc(table->capacity, sizeof(dir_info_t));
+        
+        for(size_t i=0; i < old_capacity; i++) {
+            if(old_slots[i].used) {
+                *dir_info_slot(table, old_slots[i].dev, old_slots[i].ino) = old_slots[i];
+            }
+        }
+        
+        free(old_slots);
+    }
+    
+    dir_info_t* slot = dir_info_slot(table, info->dev, info->ino);
+    if(!slot->used) {
+        table->count++;
+    }
+    
+    *slot = *info;
+    slot->used = 1;
+}
+
+
+// Recursive helper function for compute_dir_size(), see below
+//
+// parameters:
+//      scan       - the scan the sizes are computed for
+//      parent_fd  - file descriptor of the parent directory, or AT_FDCWD
+//      dir_name   - the name of the directory to be scanned in the parent directory
+//      table      - the table to store the information of visited directories in
+//      dir_info   - pointer to where to store the size and digest of the directory
+//
+//      dont_store - flag indicating whether or not to store the directory information in
+//                   the table, used by recursive calls to skip storing hidden directories
+//                   when hidden entries are not visited. 0 indicates this flag is false
+//                   1 indicates the flag is true
+//
+// returns: void
+//
+static void compute_dir_size_r(gls_scan_t* scan, int parent_fd, const char* dir_name, dir_info_table_t* table, dir_info_t* dir_info, int dont_store) {
+    memset(dir_info, 0, sizeof(dir_info_t));
+    
+    // The directory is read unsorted, the sizes do not depend on the order and the
+    // digests are computed in name order by digest_directory()
+    int dir_fd = open_directory(parent_fd, dir_name);
+    
+    struct dirent** entries;
+    int num_entries = (dir_fd < 0) ? -1 : scan_directory(dir_fd, &entries, filter_show_hidden, NULL, NULL);
+    
+    // Check if directory was successfully scanned otherwise exit function, a directory
+    // which cannot be opened is not stored since parse_directory() cannot list it either.
+    // A directory which could not be read has an error digest rather than that of an
+    // empty directory and makes the digests above it incomplete
+    if(num_entries <= 0) {
+        if(num_entries == 0) {
+            // Directory was successfully scanned but had no entries
+            free(entries);
+            
+            if(scan->options->digests) {
+                digest_directory(NULL, 0, NULL, dir_info->digest);
+            }
+        } else {
+            memset(dir_info->digest, DIGEST_ERROR_BYTE, MD5_DIGEST_LENGTH);
+            dir_info->incomplete = 1;
+        }
+        
+        if(dir_fd >= 0) {
+            struct stat dir_stat;
+            if(!dont_store && fstat(dir_fd, &dir_stat) == 0) {
+                dir_info->dev = dir_stat.st_dev;
+                dir_info->ino = dir_stat.st_ino;
+                dir_info_insert(table, dir_info);
+            }
+            
+            close(dir_fd);
+        }
+        return;
+    }
+    
+    // Contents digests of the entries in scan order, entries which could not be read have
+    // an error digest
+    unsigned char* entry_digests = scan->options->digests ? calloc(num_entries, MD5_DIGEST_LENGTH) : NULL;
+    
+    // Regular files are only hashed for the digests
+    hash_batch_t batch;
+    hash_batch_init(&batch, scan, dir_fd, entries, num_entries, NULL, scan->options->digests);
+    
+    for(int i=0; i < num_entries; i++) {
+        struct dirent* current_dirent = entries[i];
+        
+        // Recursively calculate size of subdirectory
+        if(current_dirent->d_type == DT_DIR) {
+            
+            // If the subdirectory in question is a hidden subdirectory and hidden entries are not
+            // visited then its information (and that of the directories below it) is not needed
+            // by parse_directory() and is not stored in the table, only added to this directory
+            int subdir_dont_store = (current_dirent->d_name[0] == '.' && !scan->options->show_hidden) || dont_store == 1;
+            
+            dir_info_t subdir_info;
+            compute_dir_size_r(scan, dir_fd, current_dirent->d_name, table, &subdir_info, subdir_dont_store);
+            
+            // Add subdirectory size to current directory size
+            dir_info->size       += subdir_info.size;
+            dir_info->incomplete |= subdir_info.incomplete;
+            
+            if(scan->options->digests) {
+                memcpy(entry_digests + i * MD5_DIGEST_LENGTH, subdir_info.digest, MD5_DIGEST_LENGTH);
+            }
+            
+        } else if(current_dirent->d_type == DT_REG) {
+            // Get file size
+            const hash_job_t* job = hash_batch_get(&batch, i);
+            
+            // If stat fails the file adds nothing to the size
+            if(job->stat_error == 0) {
+                dir_info->size += job->info.st_size;
+            }
+            
+            if(scan->options->digests) {
+                if(job->stat_error == 0 && job->hash_result == 0) {
+                    memcpy(entry_digests + i * MD5_DIGEST_LENGTH, job->md5, MD5_DIGEST_LENGTH);
+                } else {
+                    memset(entry_digests + i * MD5_DIGEST_LENGTH, DIGEST_ERROR_BYTE, MD5_DIGEST_LENGTH);
+                    dir_info->incomplete = 1;
+                }
+            }
+        } else if(scan->options->digests) {
+            if(digest_entry_contents(dir_fd, current_dirent, entry_digests + i * MD5_DIGEST_LENGTH) < 0) {
+                dir_info->incomplete = 1;
+            }
+        }
+    }
+    
+    hash_batch_free(&batch);
+    
+    if(scan->options->digests) {
+        digest_directory(entries, num_entries, entry_digests, dir_info->digest);
+        free(entry_digests);
+    }
+    
+    // Free memory for dirent array
+    for(int i=0; i < num_entries; i++) {
+        free(entries[i]);
+    }
+    free(entries);
+    
+    struct stat dir_stat;
+    if(!dont_store && fstat(dir_fd, &dir_stat) == 0) {
+        dir_info->dev = dir_stat.st_dev;
+        dir_info->ino = dir_stat.st_ino;
+        dir_info_insert(table, dir_info);
+    }
+    
+    close(dir_fd);
+}
+
+
+// Recursively traverses the file tree at root 'dir_name' and computes directory sizes,
+// and merkle digests if requested, to be returned in a table
+//
+// parameters:
+//      scan      - the scan the sizes are computed for
+//      parent_fd - file descriptor of the parent directory, or AT_FDCWD
+//      dir_name  - the name of the directory to be scanned in the parent directory
+//
+// returns: dir_info_table_t*
+//      A table with the sizes and digests of 'dir_name' and every directory below it that
+//      parse_directory() visits, looked up with dir_info_lookup(). Must be freed using
+//      dir_info_free()
+//
+static dir_info_table_t* compute_dir_size(gls_scan_t* scan, int parent_fd, const char* dir_name) {
+    dir_info_table_t* table = malloc(sizeof(dir_info_table_t));
+    table->capacity = 16;
+    table->count    = 0;
+    table->slots    = calloc(table->capacity, sizeof(dir_info_t));
+    
+    dir_info_t root_info;
+    compute_dir_size_r(scan, parent_fd, dir_name, table, &root_info, 0);
+    
+    return table;
+}
+
+
+// Looks up the information of an open directory in a table computed by compute_dir_size()
+//
+// parameters:
+//      table  - the directory information table
+//      dir_fd - file descriptor of the directory
+//
+// returns: const dir_info_t*
+//      the information of the directory, NULL if it is not in the table (i.e. it was
+//      created or replaced after the sizes were computed)
+//
+static const dir_info_t* dir_info_lookup(dir_info_table_t* table, int dir_fd) {
+    struct stat dir_stat;
+    if(fstat(dir_fd, &dir_stat) < 0) {
+        return NULL;
+    }
+    
+    dir_info_t* slot = dir_info_slot(table, dir_stat.st_dev, dir_stat.st_ino);
+    
+    return slot->used ? slot : NULL;
+}
+
+
+// Frees a table computed by compute_dir_size()
+//
+// parameters:
+//      table - the table to free, may be NULL
+//
+// returns: void
+//
+static void dir_info_free(dir_info_table_t* table) {
+    if(table != NULL) {
+        free(table->slots);
+        free(table);
+    }
+}
+
+
+
+
+// Appends a name to the relative path of the current entry
+//
+// parameters:
+//      scan - the scan to update the path of
+//      name - the name of the entry in the current directory
+//
+// returns: size_t
+//      the previous length of the path, to be passed to path_pop()
+//
+static size_t path_push(gls_scan_t* scan, const char* name) {
+    size_t old_length  = scan->path_length;
+    size_t name_length = strlen(name);
+    size_t new_length  = (old_length > 0) ? old_length + 1 + name_length : name_length;
+    
+    // Double the capacity until the path fits (see scan_directory())
+    while(new_length + 1 > scan->path_capacity) {
+        scan->path_capacity *= 2;
+        scan->path = realloc(scan->path, scan->path_capacity);
+    }
+    
+    if(old_length > 0) {
+        scan->path[old_length] = '/';
+    }
+    memcpy(scan->path + new_length - name_length, name, name_length + 1);
+    scan->path_length = new_length;
+    
+    return old_length;
+}
+
+
+// Restores the relative path of the current entry to what it was before path_push()
+//
+// parameters:
+//      scan       - the scan to update the path of
+//      old_length - the length returned by path_push()
+//
+// returns: void
+//
+static void path_pop(gls_scan_t* scan, size_t old_length) {
+    scan->path[old_length] = '\0';
+    scan->path_length = old_length;
+}
+
+
+// Calls a visitor callback and records a nonzero return value to stop the scan
+//
+// parameters:
+//      scan     - the scan the callback is called for
+//      callback - the callback, may be NULL
+//      entry    - the entry passed to the callback
+//
+// returns: void
+//
+static void visit(gls_scan_t* scan, int (*callback)(const gls_entry_t*, void*), const gls_entry_t* entry) {
+    if(callback != NULL && scan->result == 0) {
+        scan->result = callback(entry, scan->visitor->context);
+    }
+}
+
+
+// Fills in the fields common to all entries, the remaining fields are set to their
+// values for when they are not known
+//
+// parameters:
+//      scan   - the scan the entry belongs to
+//      entry  - the entry to initialize
+//      dir_fd - file descriptor of the directory containing the entry, or AT_FDCWD for the root
+//      name   - the name of the entry
+//      type   - type of the entry (as specified in dirent struct)
+//      depth  - depth of the entry
+//
+// returns: void
+//
+static void entry_init(const gls_scan_t* scan, gls_entry_t* entry, int dir_fd, const char* name, unsigned char type, int depth) {
+    memset(entry, 0, sizeof(gls_entry_t));
+    
+    entry->name   = name;
+    entry->path   = scan->path;
+    entry->type   = type;
+    entry->depth  = depth;
+    entry->dir_fd = (dir_fd == AT_FDCWD) ? -1 : dir_fd;
+    entry->size   = -1;
+}
+
+
+// Gathers the information on a symbolic link and visits it
+//
+// parameters:
+//      scan           - the scan the entry belongs to
+//      entry          - the entry initialized by entry_init()
+//      current_dirent - the directory entry of the symbolic link
+//
+// returns: void
+//
+static void visit_symlink(gls_scan_t* scan, gls_entry_t* entry, const struct dirent* current_dirent) {
+    // Determine the size of the symlink itself
+    struct stat symlink_info;
+    if(fstatat(entry->dir_fd, current_dirent->d_name, &symlink_info, AT_SYMLINK_NOFOLLOW) < 0) {
+        entry->error        = GLS_ERROR_STAT_SYMLINK;
+        entry->error_number = errno;
+        visit(scan, scan->visitor->visit_entry, entry);
+        return;
+    }
+    entry->size = symlink_info.st_size;
+    
+    // Determine what the symlink points to
+    char symlink_name[PATH_MAX + 1];
+    ssize_t symlink_size = readlinkat(entry->dir_fd, current_dirent->d_name, symlink_name, PATH_MAX);
+    if(symlink_size < 0) {
+        entry->error        = GLS_ERROR_READ_SYMLINK;
+        entry->error_number = errno;
+        visit(scan, scan->visitor->visit_entry, entry);
+        return;
+    }
+    symlink_name[symlink_size] = '\0';
+    entry->link_contents = symlink_name;
+    
+    // Determine the absolute path of the symlink, realpath() needs the path of the symlink
+    // from the working directory which is the root path followed by the relative path
+    char* symlink_path = malloc(strlen(scan->root_path) + 1 + scan->path_length + 1);
+    sprintf(symlink_path, "%s/%s", scan->root_path, scan->path);
+    
+    char* absolute_path = realpath(symlink_path, NULL);
+    if(absolute_path == NULL) {
+        entry->error        = GLS_ERROR_RESOLVE_SYMLINK;
+        entry->error_number = errno;
+    }
+    entry->link_path = absolute_path;
+    
+    visit(scan, scan->visitor->visit_entry, entry);
+    
+    free(absolute_path);
+    free(symlink_path);
+}
+
+
+// Recursive helper function for parse_directory(), see below
+//
+// parameters:
+//      scan      - the scan the directory is visited for
+//      parent_fd - file descriptor of the parent directory, or AT_FDCWD for the root
+//      dir_name  - the name of the directory to be scanned in the parent directory
+//      dir_infos - a table of directory sizes and digests, NULL if the sizes are not computed
+//                  or if the sizes of the subdirectories of the root should be computed as
+//                  they are reached
+//      cur_depth - current number of subdirectories followed
+//
+// returns: void
+//
+static void parse_directory_r(gls_scan_t* scan, int parent_fd, const char* dir_name, dir_info_table_t* dir_infos, int cur_depth) {
+    gls_entry_t dir_entry;
+    entry_init(scan, &dir_entry, parent_fd, dir_name, DT_DIR, cur_depth);
+    
+    int dir_fd = open_directory(parent_fd, dir_name);
+    
+    // Entries which are not sorted are visited as they are read from the directory,
+    // otherwise the whole directory is read and sorted before it is entered
+    struct dirent** entries = NULL;
+    DIR*            stream  = NULL;
+    int             num_entries;
+    
+    if(dir_fd < 0) {
+        num_entries = -1;
+    } else if(scan->sort_key_function == NULL) {
+        stream      = open_directory_stream(dir_fd);
+        num_entries = (stream == NULL) ? -1 : 0;
+    } else {
+        num_entries = scan_directory(dir_fd, &entries, scan->filter_function, scan->sort_key_function, dir_infos);
+    }
+    
+    hash_batch_t batch;
+    if(num_entries >= 0) {
+        hash_batch_init(&batch, scan, dir_fd, entries, num_entries, stream, scan->options->hash_files);
+        
+        // The first entry is read before the directory is entered, so whether it can be
+        // read and whether it is empty are known then
+        if(stream != NULL && hash_batch_entry(&batch, 0) == NULL && batch.read_error != 0) {
+            hash_batch_free(&batch);
+            errno       = batch.read_error;
+            num_entries = -1;
+        }
+    }
+    
+    // Check if directory was succesfully scanned otherwise report the error and return
+    if(num_entries < 0) {
+        dir_entry.error        = GLS_ERROR_SCAN_DIRECTORY;
+        dir_entry.error_number = errno;
+        
+        if(dir_fd >= 0) {
+            close(dir_fd);
+        }
+        
+        visit(scan, scan->visitor->enter_directory, &dir_entry);
+        visit(scan, scan->visitor->leave_directory, &dir_entry);
+        return;
+    }
+    
+    // A directory created or replaced since the sizes were computed has no size
+    const dir_info_t* dir_info = (dir_infos != NULL) ? dir_info_lookup(dir_infos, dir_fd) : NULL;
+    if(dir_info != NULL) {
+        dir_entry.size              = dir_info->size;
+        dir_entry.has_digest        = scan->options->digests;
+        dir_entry.digest_incomplete = scan->options->digests && dir_info->incomplete;
+        memcpy(dir_entry.digest, dir_info->digest, MD5_DIGEST_LENGTH);
+    }
+    
+    // The number of entries of a stream is only known once it was read to the end
+    if(stream != NULL) {
+        dir_entry.num_entries = (batch.num_entries > 0) ? -1 : 0;
+    } else {
+        dir_entry.num_entries = num_entries;
+    }
+    
+    visit(scan, scan->visitor->enter_directory, &dir_entry);
+    
+    struct dirent* current_dirent;
+    for(int i=0; (current_dirent = hash_batch_entry(&batch, i)) != NULL; i++) {
+        
+        // Once a callback stopped the scan the remaining entries are skipped
+        if(scan->result != 0) {
+            break;
+        }
+        
+        size_t old_length = path_push(scan, current_dirent->d_name);
+        
+        if(current_dirent->d_type == DT_DIR) {          // Subdirectories
+            
+            // Parse subdirectory recursively
+            if(dir_infos == NULL && cur_depth == 0 && scan->options->dir_sizes) {
+                
+                // The sizes are computed one subdirectory of the root at a time so that the
+                // first entries are visited after the first subtree has been sized rather
+                // than the whole tree
+                dir_info_table_t* subdir_infos = compute_dir_size(scan, dir_fd, current_dirent->d_name);
+                
+                parse_directory_r(scan, dir_fd, current_dirent->d_name, subdir_infos, cur_depth+1);
+                
+                dir_info_free(subdir_infos);
+            } else {
+                parse_directory_r(scan, dir_fd, current_dirent->d_name, dir_infos, cur_depth+1);
+            }
+            
+        } else {
+            gls_entry_t entry;
+            entry_init(scan, &entry, dir_fd, current_dirent->d_name, current_dirent->d_type, cur_depth+1);
+            
+            if(current_dirent->d_type == DT_REG) {      // Regular files
+                
+                // Get file size and MD5 checksum of file, the checksum is looked up if it was
+                // already computed for the digests
+                const hash_job_t* job = hash_batch_get(&batch, i);
+                if(job->stat_error != 0) {
+                    entry.error        = GLS_ERROR_STAT_FILE;
+                    entry.error_number = job->stat_error;
+                } else {
+                    entry.size = job->info.st_size;
+                    
+                    if(scan->options->hash_files) {
+                        if(job->hash_result == 0) {
+                            memcpy(entry.digest, job->md5, MD5_DIGEST_LENGTH);
+                            entry.has_digest = 1;
+                        } else {
+                            entry.error        = GLS_ERROR_HASH_FILE;
+                            entry.error_number = job->hash_error;
+                        }
+                    }
+                }
+                
+                visit(scan, scan->visitor->visit_entry, &entry);
+                
+            } else if(current_dirent->d_type == DT_LNK) {   // Symbolic links
+                visit_symlink(scan, &entry, current_dirent);
+            } else {                                        // Other (i.e. character devices and block devices)
+                visit(scan, scan->visitor->visit_entry, &entry);
+            }
+        }
+        
+        path_pop(scan, old_length);
+    }
+    
+    // A stream which failed part way is reported when leaving the directory
+    if(stream != NULL) {
+        dir_entry.num_entries = batch.num_entries;
+        
+        if(batch.read_error != 0) {
+            dir_entry.error        = GLS_ERROR_SCAN_DIRECTORY;
+            dir_entry.error_number = batch.read_error;
+        }
+    }
+    
+    // Files still queued or being hashed use the entries and the directory
+    hash_batch_free(&batch);
+    
+    // Free memory for dirent array
+    for(int i=0; i < num_entries && entries != NULL; i++) {
+        free(entries[i]);
+    }
+    free(entries);
+    
+    visit(scan, scan->visitor->leave_directory, &dir_entry);
+    
+    close(dir_fd);
+}
+
+
+// Sets all options to their defaults, see libgls.h
+//
+void gls_options_init(gls_options_t* options) {
+    options->show_hidden = 0;
+    options->hash_files  = 1;
+    options->dir_sizes   = 1;
+    options->digests     = 0;
+    options->sort        = GLS_SORT_NAME_BYTES;
+    options->cache_path  = NULL;
+    options->cache       = NULL;
+    options->pool        = NULL;
+}
+
+
+// Traverses the file tree at root 'dir_path' passing every entry to the visitor
+// callbacks, see libgls.h
+//
+int gls_scan(const char* dir_path, const gls_options_t* options, const gls_visitor_t* visitor) {
+    gls_scan_t scan;
+    memset(&scan, 0, sizeof(scan));
+    
+    scan.options         = options;
+    scan.visitor         = visitor;
+    scan.root_path       = dir_path;
+    scan.filter_function = options->show_hidden ? filter_show_hidden : filter_hidden;
+    
+    switch(options->sort) {
+        case GLS_SORT_SIZE:
+            scan.sort_key_function = sort_key_size;
+            break;
+        
+        case GLS_SORT_MTIME:
+            scan.sort_key_function = sort_key_mtime;
+            break;
+        
+        case GLS_SORT_NONE:
+            scan.sort_key_function = NULL;
+            break;
+        
+        default:
+            scan.sort_key_function = sort_key_name_bytes;
+    }
+    
+    scan.path_capacity = 256;
+    scan.path          = calloc(scan.path_capacity, 1);
+    
+    // The hash cache is only needed when files are hashed twice (once for the digests
+    // and once for the entries) or when checksums are reused from a previous scan. A
+    // shared cache is loaded and saved by its owner rather than by the scan
+    if(options->cache != NULL) {
+        scan.hash_cache = options->cache;
+    } else if(options->digests || options->cache_path != NULL) {
+        scan.hash_cache      = gls_cache_create(options->cache_path, 0);
+        scan.owns_hash_cache = (scan.hash_cache != NULL);
+    }
+    
+    // The size and digest of the root directory are only computed along with its digest,
+    // or when the subdirectories of the root are ordered by their sizes, otherwise the
+    // sizes are computed per subdirectory by parse_directory_r()
+    int root_sizes = options->digests || (options->sort == GLS_SORT_SIZE && options->dir_sizes);
+    
+    dir_info_table_t* dir_infos = root_sizes ? compute_dir_size(&scan, AT_FDCWD, dir_path) : NULL;
+    
+    parse_directory_r(&scan, AT_FDCWD, dir_path, dir_infos, 0);
+    
+    dir_info_free(dir_infos);
+    free(scan.path);
+    
+    int result = scan.result;
+    if(scan.owns_hash_cache) {
+        if(options->cache_path != NULL && gls_cache_save(scan.hash_cache, options->cache_path) < 0 && result == 0) {
+            result = -1;
+        }
+        
+        gls_cache_free(scan.hash_cache);
+    }
+    
+    return result;
+}
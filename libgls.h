@@ -0,0 +1,306 @@
+//
+//  libgls.h
+//
+//  link with:
+//      Linux:  gcc -Wall program.c libgls.a -o program -lssl -lcrypto -lpthread
+//      OS X:   gcc -Wall program.c libgls.a -o program
+//
+//
+// Description:
+// ---------------------------------------------------------------------------------------------------
+//
+// libgls - the file tree traversal, directory sizing and hashing behind gls, for use
+// from other programs without running gls and parsing its output. A scan walks the
+// tree at a root directory in the same order gls prints it and passes every entry to
+// visitor callbacks as a gls_entry_t struct, nothing is formatted as text.
+//
+// A scan does not change the working directory and keeps all of its state in the
+// scan, so separate scans can run at the same time from different threads. Scans of
+// several trees running at the same time can share one file hash cache (see
+// gls_cache_create()) so a file is only hashed once even when it is hard linked into
+// more than one of the trees, a scan reaching a file another scan is hashing waits
+// for its checksum. They can also share a pool of threads (see gls_pool_create())
+// which hash the files of every scan a little ahead of it, so the threads are not
+// tied to a tree and keep working for the trees which take longest.
+//
+//
+// example:
+//
+//      static int count_file(const gls_entry_t* entry, void* context) {
+//          (*(long*)context)++;
+//          return 0;
+//      }
+//
+//      long num_files = 0;
+//      gls_visitor_t visitor = { NULL, NULL, count_file, &num_files };
+//
+//      gls_options_t options;
+//      gls_options_init(&options);
+//
+//      gls_scan("/Users/Me/Desktop", &options, &visitor);
+//
+
+#ifndef LIBGLS_H
+#define LIBGLS_H
+
+#include <sys/types.h>
+#include <dirent.h>
+
+
+// Number of bytes in an md5 checksum or directory digest
+#define GLS_DIGEST_LENGTH 16
+
+
+// Order the entries of each directory are visited in
+typedef enum {
+    GLS_SORT_NAME_BYTES,        // By name in byte order
+    GLS_SORT_SIZE,              // By size largest first, the 'size' visited for directories and the size
+                                // of the entry itself as for 'ls -S' for other entries
+    GLS_SORT_MTIME,             // By modification time newest first
+    GLS_SORT_NONE               // In the order entries are read from the directory, each entry is
+                                // visited as it is read rather than after the whole directory
+} gls_sort_t;
+
+
+// Error encountered while gathering the information of an entry, the fields of the
+// entry which could not be filled in are left as described for gls_entry_t
+typedef enum {
+    GLS_ERROR_NONE = 0,
+    GLS_ERROR_SCAN_DIRECTORY,   // The directory could not be read, it has no entries. With GLS_SORT_NONE
+                                // a directory which failed after some entries were visited is only
+                                // reported to leave_directory
+    GLS_ERROR_STAT_FILE,        // The regular file could not be stat'ed, 'size' is -1
+    GLS_ERROR_HASH_FILE,        // The md5 checksum of the regular file could not be computed
+    GLS_ERROR_STAT_SYMLINK,     // The symbolic link could not be lstat'ed
+    GLS_ERROR_READ_SYMLINK,     // The contents of the symbolic link could not be read
+    GLS_ERROR_RESOLVE_SYMLINK   // The absolute path of the symbolic link could not be resolved
+} gls_error_t;
+
+
+// Information on a single entry of the tree, passed to the visitor callbacks. The struct
+// and the strings it points to are only valid for the duration of the callback
+typedef struct {
+    const char*   name;             // Name of the entry, for the root directory the path given to gls_scan()
+    const char*   path;             // Path relative to the root directory, "" for the root directory
+    unsigned char type;             // Type of the entry (as specified in dirent struct, i.e. DT_REG)
+    int           depth;            // 0 for the root directory, 1 for its entries and so on
+    int           dir_fd;           // File descriptor of the directory containing the entry, -1 for the root
+
+    off_t         size;             // Size in bytes of a regular file, or of all regular files below a
+                                    // directory (including hidden ones), -1 if not known
+
+    int           num_entries;      // Number of entries visited in a directory, 0 for other entries. With
+                                    // GLS_SORT_NONE the entries are counted as they are read, so
+                                    // enter_directory gets -1 for a directory which is not empty
+
+    int           has_digest;       // Nonzero if 'digest' holds the md5 checksum of a regular file or
+    unsigned char digest[GLS_DIGEST_LENGTH];    // the merkle digest of a directory
+
+    int           digest_incomplete;    // Nonzero if some entry below a directory could not be read, the
+                                        // digest then marks those entries as errors instead of describing
+                                        // their contents
+
+    const char*   link_contents;    // Contents of a symbolic link (i.e. where it points to), NULL if not read
+    const char*   link_path;        // Absolute path a symbolic link resolves to, NULL if not resolved
+
+    gls_error_t   error;            // Error encountered for the entry, GLS_ERROR_NONE if none
+    int           error_number;     // errno value of the error, 0 for md5 hashing errors
+} gls_entry_t;
+
+
+// Visitor callbacks, any of which may be NULL. A nonzero return value stops the scan
+// and is returned by gls_scan()
+typedef struct {
+    // Called for every directory including the root before its entries are visited
+    int (*enter_directory)(const gls_entry_t* entry, void* context);
+
+    // Called for every directory after its entries were visited, also when it could not be read
+    int (*leave_directory)(const gls_entry_t* entry, void* context);
+
+    // Called for every entry which is not a directory
+    int (*visit_entry)(const gls_entry_t* entry, void* context);
+
+    // Passed to every callback
+    void* context;
+} gls_visitor_t;
+
+
+// File hash cache mapping files (device and inode number) to the md5 checksums of their
+// contents, a checksum is only reused while the size and timestamps of the file are unchanged
+typedef struct gls_cache gls_cache_t;
+
+
+// Threads hashing files ahead of the scans sharing the pool, in the order the scans
+// queue them
+typedef struct gls_pool gls_pool_t;
+
+
+// Options for a scan, initialize with gls_options_init() before changing fields
+typedef struct {
+    int          show_hidden;        // Nonzero to visit hidden files and directories (default: 0)
+    int          hash_files;         // Nonzero to compute md5 checksums of regular files (default: 1)
+    int          dir_sizes;          // Nonzero to compute the sizes of directories (default: 1)
+    int          digests;            // Nonzero to compute merkle digests of directories (default: 0)
+    gls_sort_t   sort;               // Order of the entries of each directory (default: GLS_SORT_NAME_BYTES)
+    const char*  cache_path;         // File to reuse md5 checksums of unchanged files from and save
+                                     // them to, NULL for none (default: NULL)
+    gls_cache_t* cache;              // Hash cache shared with other scans, NULL for a cache owned by
+                                     // the scan. 'cache_path' is ignored when set, the shared cache
+                                     // is loaded and saved by its creator (default: NULL)
+    gls_pool_t*  pool;               // Pool to hash files ahead of the scan with, NULL to hash every
+                                     // file on the thread calling gls_scan() (default: NULL)
+} gls_options_t;
+
+
+// Sets all options to their defaults
+//
+// parameters:
+//      options - the options to initialize
+//
+// returns: void
+//
+void gls_options_init(gls_options_t* options);
+
+
+// Traverses the file tree at root 'dir_path' passing every entry to the visitor callbacks.
+// The size of the root directory is only computed when digests are computed or entries
+// are sorted by size since it requires walking the whole tree before the first entry is
+// visited, otherwise the sizes are computed one subdirectory of the root at a time
+//
+// parameters:
+//      dir_path - the path of the directory to be scanned
+//      options  - the options for the scan
+//      visitor  - the visitor callbacks
+//
+// returns: int
+//      0 if the whole tree was visited, -1 if the hash cache could not be saved to
+//      'cache_path' in which case errno is set appropriately, otherwise the nonzero
+//      value returned by the callback which stopped the scan (callbacks should
+//      return positive values to tell them apart)
+//
+int gls_scan(const char* dir_path, const gls_options_t* options, const gls_visitor_t* visitor);
+
+
+// Creates an empty hash cache to be shared by scans through the 'cache' option, and
+// loads it from the cache file at 'path' unless it is NULL. A cache file which cannot
+// be read is ignored. The cache is safe to use from scans running at the same time.
+// A cache keeping only hard linked files shares their hashing between the scans
+// without holding an entry for every file, but files are then hashed twice by scans
+// computing digests
+//
+// parameters:
+//      path            - path of the cache file, NULL for none
+//      hard_links_only - nonzero to only keep the checksums of files with more than one link
+//
+// returns: gls_cache_t*
+//      the new cache, NULL if memory could not be allocated
+//
+gls_cache_t* gls_cache_create(const char* path, int hard_links_only);
+
+
+// Saves the checksums of the files seen by the scans which used the cache to the file
+// at 'path', entries for files which no longer exist are dropped this way. The file is
+// written under a temporary name in the same directory and renamed over 'path', so the
+// previous cache file stays intact if saving fails. The file keeps the mode of the
+// previous cache file, a new one is created according to the umask
+//
+// parameters:
+//      cache - the cache to save
+//      path  - path of the cache file
+//
+// returns: int
+//      0 if the cache was saved successfully, -1 otherwise with errno set appropriately
+//
+int gls_cache_save(gls_cache_t* cache, const char* path);
+
+
+// Frees a cache created with gls_cache_create(), no scan may be using it
+//
+// parameters:
+//      cache - the cache to free, may be NULL
+//
+// returns: void
+//
+void gls_cache_free(gls_cache_t* cache);
+
+
+// Creates a pool of threads to be shared by scans through the 'pool' option. A scan
+// queues the regular files a few entries ahead of the one it is visiting and hashes
+// them itself if no thread of the pool has taken them when it gets there, so entries
+// are still visited in order and a scan never waits on files of other scans
+//
+// parameters:
+//      num_threads - number of threads to start, may be 0 when threads are only lent to
+//                    the pool with gls_pool_work()
+//
+// returns: gls_pool_t*
+//      the new pool, NULL if memory could not be allocated
+//
+gls_pool_t* gls_pool_create(int num_threads);
+
+
+// Lends the calling thread to the pool, hashing queued files until the pool is shut down.
+// Returns immediately if the pool was already shut down
+//
+// parameters:
+//      pool - the pool
+//
+// returns: void
+//
+void gls_pool_work(gls_pool_t* pool);
+
+
+// Shuts down the pool once no scan is using it any more, threads in gls_pool_work() return
+//
+// parameters:
+//      pool - the pool
+//
+// returns: void
+//
+void gls_pool_shutdown(gls_pool_t* pool);
+
+
+// Shuts down the pool and frees it once its threads and the threads lent to it have
+// returned, no scan may be using it
+//
+// parameters:
+//      pool - the pool to free, may be NULL
+//
+// returns: void
+//
+void gls_pool_free(gls_pool_t* pool);
+
+
+// Computes md5 checksum of the contents of the open file 'fd', read from its current
+// offset to the end
+//
+// parameters:
+//      fd        - file descriptor of the file opened for reading
+//      blk_size  - blocksize for efficient filesystem I/O, can be obtained from stat struct field 'st_blksize'
+//      md5_bytes - pointer to a buffer of at least GLS_DIGEST_LENGTH bytes to hold the checksum
+//
+// returns: int
+//      0 if the md5 checksum was computed successfully, otherwise -1 will be returned.
+//      If the error was due to file IO errno will be set appropriately, otherwise the
+//      error was caused by the MD5 hashing. Thus errno should be cleared before calling
+//      this function.
+//
+int gls_fdcompute_md5(int fd, blksize_t blk_size, unsigned char* md5_bytes);
+
+
+// Converts the raw md5 checksum 'md5_bytes' into a string of hexadecimal characters
+// and places it into the buffer pointed to by 'md5_str' including the null terminator.
+// If the buffer size 'n' is less than GLS_DIGEST_LENGTH*2 + 1 = 33 bytes then the
+// string is truncated to n-1 characters and null terminated
+//
+// parameters:
+//      md5_bytes - the GLS_DIGEST_LENGTH bytes of the checksum
+//      md5_str   - pointer to a buffer to hold the md5 checksum hexadecimal string
+//      n         - the size of the buffer in bytes
+//
+// returns: void
+//
+void gls_md5_to_strn(const unsigned char* md5_bytes, char* md5_str, unsigned int n);
+
+
+#endif